@@ -1,588 +1,314 @@
-
 #include <stdio.h>
 #include <stdlib.h> /* for malloc, free, srand, rand */
 #include <string.h>
 
-/*******************************************************************
- ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
-
-   This code should be used for PA2, unidirectional or bidirectional
-   data transfer protocols (from A to B. Bidirectional transfer of data
-   is for extra credit and is not required).  Network properties:
-   - one way network delay averages five time units (longer if there
-     are other messages in the channel for GBN), but can be larger
-   - packets can be corrupted (either the header or the data portion)
-     or lost, according to user-defined probabilities
-   - packets will be delivered in the order in which they were sent
-     (although some can be lost).
-**********************************************************************/
-
-#define BIDIRECTIONAL 0 /* change to 1 if you're doing extra credit */
-                        /* and write a routine called B_output */
-
-/* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
-/* 4 (students' code).  It contains the data (characters) to be delivered */
-/* to layer 5 via the students transport level protocol entities.         */
-struct msg
-{
-    char data[20];
-};
-
-/* a packet is the data unit passed from layer 4 (students code) to layer */
-/* 3 (teachers code).  Note the pre-defined packet structure, which all   */
-/* students must follow. */
-struct pkt
-{
-    int seqnum;
-    int acknum;
-    int checksum;
-    char payload[20];
-};
-
-void tolayer3(int AorB, struct pkt packet);
-void tolayer5(int AorB, char datasent[20]);
-void starttimer(int AorB, float increment);
-void stoptimer(int AorB);
-
-/* Forward declaration of struct event */
-struct event;
+#include "rdt.h"
+#include "checksum.h"
 
 /********* STUDENTS WRITE THE NEXT SEVEN ROUTINES *********/
 
-/* Here I define some function prototypes to avoid warnings */
-/* in my compiler. Also I declared these functions void and */
-/* changed the implementation to match */
-void init();
-void generate_next_arrival();
-void insertevent(struct event *p);
-
-/* ========== 辅助函数 ========== */
-int compute_checksum(struct pkt *p) {
-    int sum = p->seqnum + p->acknum;
-    for (int i = 0; i < 20; i++) sum += (unsigned char)p->payload[i];
-    return sum;
-}
+#define QUEUE_INIT 16    /* 发送队列的初始大小，不够时加倍直到 QUEUE_SIZE */
+#define QUEUE_SIZE 1024  /* 等待ACK期间最多排队的上层消息数，再多就丢弃 */
 
-int is_corrupted(struct pkt *p) { return compute_checksum(p) != p->checksum; }
+#ifndef TIMEOUT_INTERVAL
+#define TIMEOUT_INTERVAL 20.0 /* 重传超时，编译时可用 -DTIMEOUT_INTERVAL=t 覆盖（见 tune.c） */
+#endif
 
+/* ========== 辅助函数 ========== */
 void make_pkt(struct pkt *p, int seq, int ack, const char *data) {
     p->seqnum = seq;
     p->acknum = ack;
+    p->length = data ? MSG_SIZE : 0;
     memset(p->payload, 0, 20);
     if (data) strncpy(p->payload, data, 20);
-    p->checksum = compute_checksum(p);
+    p->checksum = pkt_checksum(p);
 }
 
-/* ========== A 实体（发送方）状态 ========== */
-static int A_nextseqnum;
-static int A_waiting;
-static struct pkt A_lastpkt;
+/* 每个实体的状态。单向传输时 A 侧（偶数 id）只用发送方部分，B 侧只用接收方部分；
+ * 有 -b 时两侧都发数据，每个实体两部分都用 */
+struct abp_entity {
+    /* A 实体（发送方） */
+    int nextseqnum;
+    int waiting;
+    struct pkt lastpkt;
+    struct msg *queue; /* 等待ACK期间到达的上层消息，先进先出的环形队列 */
+    float *enqueued;   /* 每条消息进入队列的时间 */
+    int qhead, qcount, qcap;
+
+    /* 统计 */
+    int ndropped;      /* 队列已满而被丢弃的上层消息数 */
+    int nretransmit;   /* 超时重传次数 */
+    int ntail;         /* 其中上层交完最后一条消息之后的重传 */
+    int nsent;         /* 发出的消息数（不含重传） */
+    int qmax;          /* 队列的最大长度 */
+    double qarea;      /* 队列长度对时间的积分，除以时间即平均长度 */
+    float qchanged;    /* 队列长度上次变化的时间 */
+    double qdelay_sum; /* 每条消息在队列中等待的时间之和 */
+
+    /* B 实体（接收方） */
+    int expectedseqnum;
+    int got_data;      /* 收到过完好的数据包 */
+};
 
-/* ========== B 实体（接收方）状态 ========== */
-static int B_expectedseqnum;
+static struct abp_entity *entity; /* nentities 个，第一次 entity_init 时分配 */
 
-/* called from layer 5, passed the data to be sent to other side */
-void A_output(struct msg message)
+/* 队列长度即将变化，先把到现在为止的部分计入积分 */
+static void queue_account(struct abp_entity *a)
 {
-    if (A_waiting) {
-        printf("[A] 有未确认的包，丢弃上层消息: %s\n", message.data);
-        return;
+    a->qarea += a->qcount * (double)(time - a->qchanged);
+    a->qchanged = time;
+}
+
+/* 队列加倍，已排队的消息按新的大小重新排放 */
+static void grow_queue(struct abp_entity *a)
+{
+    int cap = a->qcap ? 2 * a->qcap : QUEUE_INIT;
+    struct msg *queue = malloc(cap * sizeof(struct msg));
+    float *enqueued = malloc(cap * sizeof(float));
+
+    for (int i = 0; i < a->qcount; i++) {
+        queue[i] = a->queue[(a->qhead + i) % a->qcap];
+        enqueued[i] = a->enqueued[(a->qhead + i) % a->qcap];
     }
+    free(a->queue);
+    free(a->enqueued);
+    a->queue = queue;
+    a->enqueued = enqueued;
+    a->qhead = 0;
+    a->qcap = cap;
+}
 
-    make_pkt(&A_lastpkt, A_nextseqnum, 0, message.data);
-    tolayer3(0, A_lastpkt);
-    starttimer(0, 20.0);
-    A_waiting = 1;
-    printf("[A] 发送数据包 seq=%d 内容=%s\n", A_lastpkt.seqnum, A_lastpkt.payload);
+/* 发送一条消息并等待它的ACK */
+static void send_msg(int id, const char *data)
+{
+    struct abp_entity *a = &entity[id];
+
+    make_pkt(&a->lastpkt, a->nextseqnum, 0, data);
+    tolayer3(id, a->lastpkt);
+    starttimer(id, TIMEOUT_INTERVAL);
+    a->waiting = 1;
+    a->nsent++;
+    trace_printf("[%s] 发送数据包 seq=%d 内容=%.20s\n", entity_name(id), a->lastpkt.seqnum, a->lastpkt.payload);
 }
 
-void B_output(struct msg message) /* need be completed only for extra credit */
+/* called from layer 5, passed the data to be sent to other side */
+static void A_output(int id, struct msg message)
 {
+    struct abp_entity *a = &entity[id];
+
+    if (!a->waiting) {
+        send_msg(id, message.data);
+        return;
+    }
+
+    /* 有未确认的包：排队，收到ACK后再发 */
+    if (a->qcount == a->qcap) {
+        if (a->qcap >= QUEUE_SIZE) {
+            trace_printf("[%s] 发送队列已满，丢弃上层消息: %.20s\n", entity_name(id), message.data);
+            a->ndropped++;
+            layer5_dropped(id);
+            return;
+        }
+        grow_queue(a);
+    }
+    queue_account(a);
+    a->queue[(a->qhead + a->qcount) % a->qcap] = message;
+    a->enqueued[(a->qhead + a->qcount) % a->qcap] = time;
+    a->qcount++;
+    if (a->qcount > a->qmax) {
+        a->qmax = a->qcount;
+    }
+    trace_printf("[%s] 有未确认的包，上层消息排队: %.20s（队列长度 %d）\n", entity_name(id), message.data,
+                 a->qcount);
 }
 
 /* called from layer 3, when a packet arrives for layer 4 */
-void A_input(struct pkt packet)
+static void A_input(int id, struct pkt packet)
 {
-    if (is_corrupted(&packet)) {
-        printf("[A] 收到损坏的ACK，忽略。\n");
+    struct abp_entity *a = &entity[id];
+
+    if (pkt_is_corrupt(&packet)) {
+        trace_printf("[%s] 收到损坏的ACK，忽略。\n", entity_name(id));
         return;
     }
 
-    if (packet.acknum == A_nextseqnum) {
-        stoptimer(0);
-        printf("[A] 收到ACK%d，发送成功。\n", packet.acknum);
-        A_nextseqnum = 1 - A_nextseqnum;
-        A_waiting = 0;
+    if (packet.acknum == a->nextseqnum) {
+        stoptimer(id);
+        trace_printf("[%s] 收到ACK%d，发送成功。\n", entity_name(id), packet.acknum);
+        a->nextseqnum = 1 - a->nextseqnum;
+        a->waiting = 0;
+        if (a->qcount > 0) { /* 每个ACK放行队首的一条消息 */
+            struct msg message = a->queue[a->qhead];
+            queue_account(a);
+            a->qdelay_sum += time - a->enqueued[a->qhead];
+            a->qhead = (a->qhead + 1) % a->qcap;
+            a->qcount--;
+            send_msg(id, message.data);
+        }
     } else {
-        printf("[A] 收到重复ACK%d，忽略。\n", packet.acknum);
+        trace_printf("[%s] 收到重复ACK%d，忽略。\n", entity_name(id), packet.acknum);
     }
 }
 
 /* called when A's timer goes off */
-void A_timerinterrupt()
+static void A_timerinterrupt(int id)
 {
-    printf("[A] 超时！重传 seq=%d\n", A_lastpkt.seqnum);
-    tolayer3(0, A_lastpkt);
-    starttimer(0, 20.0);
-}
+    struct abp_entity *a = &entity[id];
 
-/* the following routine will be called once (only) before any other */
-/* entity A routines are called. You can use it to do any initialization */
-void A_init()
-{
-    A_nextseqnum = 0;
-    A_waiting = 0;
+    trace_printf("[%s] 超时！重传 seq=%d\n", entity_name(id), a->lastpkt.seqnum);
+    a->nretransmit++;
+    if (layer5_done(id)) {
+        a->ntail++;
+    }
+    tolayer3(id, a->lastpkt);
+    starttimer(id, TIMEOUT_INTERVAL);
 }
 
-/* Note that with simplex transfer from a-to-B, there is no B_output() */
+/* 没有单独的 B_output()：双向传输时 B 的数据也走 A_output()，
+ * A_ 开头的是发送方部分，B_ 开头的是接收方部分 */
 
 /* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+static void B_input(int id, struct pkt packet)
 {
-    if (is_corrupted(&packet)) {
-        printf("[B] 收到损坏包，发送上次ACK%d\n", 1 - B_expectedseqnum);
+    struct abp_entity *b = &entity[id];
+
+    if (pkt_is_corrupt(&packet)) {
+        trace_printf("[%s] 收到损坏包，发送上次ACK%d\n", entity_name(id), 1 - b->expectedseqnum);
         struct pkt ack;
-        make_pkt(&ack, 0, 1 - B_expectedseqnum, NULL);
-        tolayer3(1, ack);
+        make_pkt(&ack, 0, 1 - b->expectedseqnum, NULL);
+        tolayer3(id, ack);
         return;
     }
 
-    if (packet.seqnum == B_expectedseqnum) {
-        printf("[B] 收到正确包 seq=%d，交付上层。\n", packet.seqnum);
-        tolayer5(1, packet.payload);
+    b->got_data = 1;
+    if (packet.seqnum == b->expectedseqnum) {
+        trace_printf("[%s] 收到正确包 seq=%d，交付上层。\n", entity_name(id), packet.seqnum);
+        tolayer5(id, packet.payload);
         struct pkt ack;
         make_pkt(&ack, 0, packet.seqnum, NULL);
-        tolayer3(1, ack);
-        printf("[B] 发送ACK%d\n", ack.acknum);
-        B_expectedseqnum = 1 - B_expectedseqnum;
+        tolayer3(id, ack);
+        trace_printf("[%s] 发送ACK%d\n", entity_name(id), ack.acknum);
+        b->expectedseqnum = 1 - b->expectedseqnum;
     } else {
-        printf("[B] 收到重复包 seq=%d，重发ACK%d\n", packet.seqnum, 1 - B_expectedseqnum);
+        trace_printf("[%s] 收到重复包 seq=%d，重发ACK%d\n", entity_name(id), packet.seqnum,
+                     1 - b->expectedseqnum);
         struct pkt ack;
-        make_pkt(&ack, 0, 1 - B_expectedseqnum, NULL);
-        tolayer3(1, ack);
+        make_pkt(&ack, 0, 1 - b->expectedseqnum, NULL);
+        tolayer3(id, ack);
     }
 }
 
-/* called when B's timer goes off */
-void B_timerinterrupt()
-{
-}
-
-/* the following rouytine will be called once (only) before any other */
-/* entity B routines are called. You can use it to do any initialization */
-void B_init()
+/* 模拟器调用的入口。每个实体都有发送方和接收方两部分，单向传输时 B 的发送方
+ * 从不被用到；到达的包按长度分：长度为 0 的是ACK，其余是数据 */
+void entity_output(int id, struct msg message)
 {
-    B_expectedseqnum = 0;
+    A_output(id, message);
 }
 
-/*****************************************************************
-***************** NETWORK EMULATION CODE STARTS BELOW ***********
-The code below emulates the layer 3 and below network environment:
-  - emulates the tranmission and delivery (possibly with bit-level corruption
-    and packet loss) of packets across the layer 3/4 interface
-  - handles the starting/stopping of a timer, and generates timer
-    interrupts (resulting in calling students timer handler).
-  - generates message to be sent (passed from later 5 to 4)
-
-THERE IS NOT REASON THAT ANY STUDENT SHOULD HAVE TO READ OR UNDERSTAND
-THE CODE BELOW.  YOU SHOLD NOT TOUCH, OR REFERENCE (in your code) ANY
-OF THE DATA STRUCTURES BELOW.  If you're interested in how I designed
-the emulator, you're welcome to look at the code - but again, you should have
-to, and you defeinitely should not have to modify
-******************************************************************/
-
-struct event
+void entity_input(int id, struct pkt packet)
 {
-    float evtime;       /* event time */
-    int evtype;         /* event type code */
-    int eventity;       /* entity where event occurs */
-    struct pkt *pktptr; /* ptr to packet (if any) assoc w/ this event */
-    struct event *prev;
-    struct event *next;
-};
-struct event *evlist = NULL; /* the event list */
-
-/* possible events: */
-#define TIMER_INTERRUPT 0
-#define FROM_LAYER5 1
-#define FROM_LAYER3 2
-
-#define OFF 0
-#define ON 1
-#define A 0
-#define B 1
-
-int TRACE = 1;   /* for my debugging */
-int nsim = 0;    /* number of messages from 5 to 4 so far */
-int nsimmax = 0; /* number of msgs to generate, then stop */
-float time = (float)0.000;
-float lossprob;    /* probability that a packet is dropped  */
-float corruptprob; /* probability that one bit is packet is flipped */
-float lambda;      /* arrival rate of messages from layer 5 */
-int ntolayer3;     /* number sent into layer 3 */
-int nlost;         /* number lost in media */
-int ncorrupt;      /* number corrupted by media*/
-
-void main()
-{
-    struct event *eventptr;
-    struct msg msg2give;
-    struct pkt pkt2give;
-
-    int i, j;
-    /* char c; // Unreferenced local variable removed */
-
-    init();
-    A_init();
-    B_init();
-
-    while (1)
-    {
-        eventptr = evlist; /* get next event to simulate */
-        if (eventptr == NULL)
-            goto terminate;
-        evlist = evlist->next; /* remove this event from event list */
-        if (evlist != NULL)
-            evlist->prev = NULL;
-        if (TRACE >= 2)
-        {
-            printf("\nEVENT time: %f,", eventptr->evtime);
-            printf("  type: %d", eventptr->evtype);
-            if (eventptr->evtype == 0)
-                printf(", timerinterrupt  ");
-            else if (eventptr->evtype == 1)
-                printf(", fromlayer5 ");
-            else
-                printf(", fromlayer3 ");
-            printf(" entity: %d\n", eventptr->eventity);
-        }
-        time = eventptr->evtime; /* update time to next event time */
-        if (nsim == nsimmax)
-            break; /* all done with simulation */
-        if (eventptr->evtype == FROM_LAYER5)
-        {
-            generate_next_arrival(); /* set up future arrival */
-            /* fill in msg to give with string of same letter */
-            j = nsim % 26;
-            for (i = 0; i < 20; i++)
-                msg2give.data[i] = 97 + j;
-            if (TRACE > 2)
-            {
-                printf("          MAINLOOP: data given to student: ");
-                for (i = 0; i < 20; i++)
-                    printf("%c", msg2give.data[i]);
-                printf("\n");
-            }
-            nsim++;
-            if (eventptr->eventity == A)
-                A_output(msg2give);
-            else
-                B_output(msg2give);
-        }
-        else if (eventptr->evtype == FROM_LAYER3)
-        {
-            pkt2give.seqnum = eventptr->pktptr->seqnum;
-            pkt2give.acknum = eventptr->pktptr->acknum;
-            pkt2give.checksum = eventptr->pktptr->checksum;
-            for (i = 0; i < 20; i++)
-                pkt2give.payload[i] = eventptr->pktptr->payload[i];
-            if (eventptr->eventity == A) /* deliver packet by calling */
-                A_input(pkt2give);       /* appropriate entity */
-            else
-                B_input(pkt2give);
-            free(eventptr->pktptr); /* free the memory for packet */
-        }
-        else if (eventptr->evtype == TIMER_INTERRUPT)
-        {
-            if (eventptr->eventity == A)
-                A_timerinterrupt();
-            else
-                B_timerinterrupt();
+    if (pkt_is_corrupt(&packet)) {
+        /* 看不出是数据还是ACK：B 和收到过数据的 A 按损坏的数据处理，重发上次的ACK，
+         * 否则 A 只可能在等ACK，忽略它 */
+        if ((id & 1) == 1 || entity[id].got_data) {
+            B_input(id, packet);
+        } else {
+            A_input(id, packet);
         }
-        else
-        {
-            printf("INTERNAL PANIC: unknown event type \n");
-        }
-        free(eventptr);
-    }
-
-terminate:
-   printf(" Simulator terminated at time %f\n after sending %d msgs from layer5\n",time,nsim);
-}
-
-void init() /* initialize the simulator */
-{
-    int i;
-    float sum, avg;
-    float jimsrand();
-
-    printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
-    printf("Enter the number of messages to simulate: ");
-    scanf("%d", &nsimmax);
-    printf("Enter  packet loss probability [enter 0.0 for no loss]:");
-    scanf("%f", &lossprob);
-    printf("Enter packet corruption probability [0.0 for no corruption]:");
-    scanf("%f", &corruptprob);
-   printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
-   scanf("%f",&lambda);
-   printf("Enter TRACE:");
-   scanf("%d",&TRACE);
-
-   srand(9999);              /* init random number generator */
-   sum = (float)0.0;         /* test random number generator for students */
-   for (i=0; i<1000; i++)
-      sum=sum+jimsrand();    /* jimsrand() should be uniform in [0,1] */
-   avg = sum/(float)1000.0;
-   if (avg < 0.25 || avg > 0.75) {
-        printf("It is likely that random number generation on your machine\n");
-        printf("is different from what this emulator expects.  Please take\n");
-        printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
-        exit(0);
+    } else if (packet.length == 0) {
+        A_input(id, packet);
+    } else {
+        B_input(id, packet);
     }
-
-   ntolayer3 = 0;
-   nlost = 0;
-   ncorrupt = 0;
-
-   time=(float)0.0;                    /* initialize time to 0.0 */
-   generate_next_arrival();     /* initialize event list */
 }
 
-/****************************************************************************/
-/* jimsrand(): return a float in range [0,1].  The routine below is used to */
-/* isolate all random number generation in one location.  We assume that the*/
-/* system-supplied rand() function return an int in therange [0,mmm]        */
-/****************************************************************************/
-float jimsrand()
+void entity_timerinterrupt(int id)
 {
-    double mmm = RAND_MAX;     /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
-    float x;                   /* individual students may need to change mmm */
-    x = (float)(rand() / mmm); /* x should be uniform in [0,1] */
-    return (x);
+    A_timerinterrupt(id);
 }
 
-/********************* EVENT HANDLINE ROUTINES *******/
-/*  The next set of routines handle the event list   */
-/*****************************************************/
-
-void generate_next_arrival()
+/* 时间序列（-T）：等待ACK的包就是在途的那一个，定时器也只在等待时运行 */
+int entity_metric(int id, int metric)
 {
-    double x;
-    struct event *evptr;
-    /* char *malloc(); // malloc redefinition removed */
-    /* float ttime; // Unreferenced local variable removed */
-    /* int tempint; // Unreferenced local variable removed */
-
-    if (TRACE > 2)
-        printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
-
-    x = lambda * jimsrand() * 2; /* x is uniform on [0,2*lambda] */
-                                 /* having mean of lambda        */
-    evptr = (struct event *)malloc(sizeof(struct event));
-    evptr->evtime = (float)(time + x);
-    evptr->evtype = FROM_LAYER5;
-    if (BIDIRECTIONAL && (jimsrand() > 0.5))
-        evptr->eventity = B;
-    else
-        evptr->eventity = A;
-    insertevent(evptr);
+    switch (metric) {
+    case METRIC_INFLIGHT:
+    case METRIC_TIMERS:
+        return entity[id].waiting;
+    case METRIC_SENDBUF:
+        return entity[id].qcount;
+    default:
+        return -1;
+    }
 }
 
-void insertevent(struct event *p)
+/* 检查点（-C/-R）：结构体整个写出，发送队列另外写，恢复时重新分配 */
+void entity_checkpoint(int id, int restoring)
 {
-    struct event *q, *qold;
+    struct abp_entity *a;
 
-    if (TRACE > 2)
-    {
-        printf("            INSERTEVENT: time is %lf\n", time);
-        printf("            INSERTEVENT: future time will be %lf\n", p->evtime);
-    }
-    q = evlist; /* q points to header of list in which p struct inserted */
-    if (q == NULL)
-    { /* list is empty */
-        evlist = p;
-        p->next = NULL;
-        p->prev = NULL;
+    if (entity == NULL) {
+        entity = calloc(nentities, sizeof(struct abp_entity));
     }
-    else
-    {
-        for (qold = q; q != NULL && p->evtime > q->evtime; q = q->next)
-            qold = q;
-        if (q == NULL)
-        { /* end of list */
-            qold->next = p;
-            p->prev = qold;
-            p->next = NULL;
-        }
-        else if (q == evlist)
-        { /* front of list */
-            p->next = evlist;
-            p->prev = NULL;
-            p->next->prev = p;
-            evlist = p;
-        }
-        else
-        { /* middle of list */
-            p->next = q;
-            p->prev = q->prev;
-            q->prev->next = p;
-            q->prev = p;
-        }
+    a = &entity[id];
+    checkpoint_data(a, sizeof(*a));
+    if (restoring) {
+        a->queue = malloc(a->qcap * sizeof(struct msg));
+        a->enqueued = malloc(a->qcap * sizeof(float));
     }
+    checkpoint_data(a->queue, a->qcap * sizeof(struct msg));
+    checkpoint_data(a->enqueued, a->qcap * sizeof(float));
 }
 
-void printevlist()
+/* 饱和源（-S）：没有未确认的包时才接收新消息，否则消息只会在队列里越积越多 */
+int entity_ready(int id)
 {
-    struct event *q;
-    /* int i; // Unreferenced local variable removed */
-    printf("--------------\nEvent List Follows:\n");
-    for (q = evlist; q != NULL; q = q->next)
-    {
-    printf("Event time: %f, type: %d entity: %d\n",q->evtime,q->evtype,q->eventity);
-    }
-    printf("--------------\n");
+    return !entity[id].waiting && entity[id].qcount == 0;
 }
 
-/********************** Student-callable ROUTINES ***********************/
-
-/* called by students routine to cancel a previously-started timer */
-void stoptimer(int AorB) /* A or B is trying to stop timer */
+/* 收尾（-F）：没有未确认的包、队列也空了才算空闲；接收方收到就应答，不欠ACK */
+int entity_idle(int id)
 {
-    struct event *q; /* ,*qold; // Unreferenced local variable removed */
-
-    if (TRACE > 2)
-        printf("          STOP TIMER: stopping timer at %f\n", time);
-    /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-    for (q = evlist; q != NULL; q = q->next)
-        if ((q->evtype == TIMER_INTERRUPT && q->eventity == AorB))
-        {
-            /* remove this event */
-            if (q->next == NULL && q->prev == NULL)
-                evlist = NULL;        /* remove first and only event on list */
-            else if (q->next == NULL) /* end of list - there is one in front */
-                q->prev->next = NULL;
-            else if (q == evlist)
-            { /* front of list - there must be event after */
-                q->next->prev = NULL;
-                evlist = q->next;
-            }
-            else
-            { /* middle of list */
-                q->next->prev = q->prev;
-                q->prev->next = q->next;
-            }
-            free(q);
-            return;
-        }
-    printf("Warning: unable to cancel your timer. It wasn't running.\n");
+    return !entity[id].waiting && entity[id].qcount == 0;
 }
 
-void starttimer(int AorB, float increment) /* A or B is trying to stop timer */
+/* the following routine will be called once (only) before any other */
+/* routines of entity id are called. You can use it to do any initialization */
+void entity_init(int id)
 {
-
-    struct event *q;
-    struct event *evptr;
-    /* char *malloc(); // malloc redefinition removed */
-
-    if (TRACE > 2)
-        printf("          START TIMER: starting timer at %f\n", time);
-    /* be nice: check to see if timer is already started, if so, then  warn */
-    /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-    for (q = evlist; q != NULL; q = q->next)
-        if ((q->evtype == TIMER_INTERRUPT && q->eventity == AorB))
-        {
-            printf("Warning: attempt to start a timer that is already started\n");
-            return;
-        }
-
-    /* create future event for when timer goes off */
-    evptr = (struct event *)malloc(sizeof(struct event));
-    evptr->evtime = (float)(time + increment);
-    evptr->evtype = TIMER_INTERRUPT;
-    evptr->eventity = AorB;
-    insertevent(evptr);
+    if (entity == NULL) {
+        entity = calloc(nentities, sizeof(struct abp_entity));
+    }
+    entity[id].nextseqnum = 0;
+    entity[id].waiting = 0;
+    entity[id].expectedseqnum = 0;
+    entity[id].got_data = 0;
 }
 
-/************************** TOLAYER3 ***************/
-void tolayer3(int AorB, struct pkt packet) /* A or B is trying to stop timer */
+/* 运行结束时由模拟器调用，打印协议统计 */
+void protocol_stats()
 {
-    struct pkt *mypktptr;
-    struct event *evptr, *q;
-    /* char *malloc(); // malloc redefinition removed */
-    float lastime, x, jimsrand();
-    int i;
-
-    ntolayer3++;
-
-    /* simulate losses: */
-    if (jimsrand() < lossprob)
-    {
-        nlost++;
-        if (TRACE > 0)
-            printf("          TOLAYER3: packet being lost\n");
-        return;
-    }
-
-    /* make a copy of the packet student just gave me since he/she may decide */
-    /* to do something with the packet after we return back to him/her */
-    mypktptr = (struct pkt *)malloc(sizeof(struct pkt));
-    mypktptr->seqnum = packet.seqnum;
-    mypktptr->acknum = packet.acknum;
-    mypktptr->checksum = packet.checksum;
-    for (i = 0; i < 20; i++)
-        mypktptr->payload[i] = packet.payload[i];
-    if (TRACE > 2)
-    {
-        printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
-               mypktptr->acknum, mypktptr->checksum);
-        for (i = 0; i < 20; i++)
-            printf("%c", mypktptr->payload[i]);
-        printf("\n");
+    int ndropped = 0, nretransmit = 0, ntail = 0, nsent = 0, qmax = 0;
+    double qarea = 0, qdelay_sum = 0;
+
+    for (int id = 0; id < nentities; id++) { /* 单向传输时 B 的这些都是 0 */
+        struct abp_entity *a = &entity[id];
+        queue_account(a);
+        ndropped += a->ndropped;
+        nretransmit += a->nretransmit;
+        ntail += a->ntail;
+        nsent += a->nsent;
+        qarea += a->qarea;
+        qdelay_sum += a->qdelay_sum;
+        if (a->qmax > qmax) {
+            qmax = a->qmax;
+        }
     }
-
-    /* create future event for arrival of packet at the other side */
-    evptr = (struct event *)malloc(sizeof(struct event));
-    evptr->evtype = FROM_LAYER3;      /* packet will pop out from layer3 */
-    evptr->eventity = (AorB + 1) % 2; /* event occurs at other entity */
-    evptr->pktptr = mypktptr;         /* save ptr to my copy of packet */
-                                      /* finally, compute the arrival time of packet at the other end.
-                                         medium can not reorder, so make sure packet arrives between 1 and 10
-                                         time units after the latest arrival time of packets
-                                         currently in the medium on their way to the destination */
-    lastime = time;
-    /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-    for (q = evlist; q != NULL; q = q->next)
-        if ((q->evtype == FROM_LAYER3 && q->eventity == evptr->eventity))
-            lastime = q->evtime;
-    evptr->evtime = lastime + 1 + 9 * jimsrand();
-
-    /* simulate corruption: */
-    if (jimsrand() < corruptprob)
-    {
-        ncorrupt++;
-        if ((x = jimsrand()) < .75)
-            mypktptr->payload[0] = 'Z'; /* corrupt payload */
-        else if (x < .875)
-            mypktptr->seqnum = 999999;
-        else
-            mypktptr->acknum = 999999;
-        if (TRACE > 0)
-            printf("          TOLAYER3: packet being corrupted\n");
+    printf(" ABP: dropped msgs: %d, retransmissions: %d", ndropped, nretransmit);
+    if (ntail > 0) {
+        printf(", after the last msg: %d", ntail);
     }
-
-    if (TRACE > 2)
-        printf("          TOLAYER3: scheduling arrival on other side\n");
-    insertevent(evptr);
+    printf("\n");
+    /* 平均队列长度按时间加权；多条流时是每条流的平均 */
+    printf(" ABP: send queue: mean %.2f msgs, max %d msgs, mean queueing delay: %f\n",
+           time > 0 ? qarea / time / nflows : 0.0, qmax, nsent > 0 ? qdelay_sum / nsent : 0.0);
 }
-
-void tolayer5(int AorB, char datasent[20])
-{
-    int i;
-    if (TRACE > 2)
-    {
-        printf("          TOLAYER5: data received: ");
-        for (i = 0; i < 20; i++)
-            printf("%c", datasent[i]);
-        printf("\n");
-    }
-}
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "checksum.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_CRC32_INSN 1
+#include <nmmintrin.h>
+#endif
+
+/* ========== Internet 校验和 ========== */
+
+/* 反码和与字节序和相加顺序无关，所以可以按 32 位甚至 128 位宽度累加，最后再折叠到 16 位 */
+unsigned int inet_sum(const void *buf, int len, unsigned int sum) {
+    const unsigned char *data = buf;
+    uint64_t acc = sum;
+    int i = 0;
+
+#if defined(__SSE2__)
+    /* 每个 16 位字零扩展到 32 位的通道里累加，每 8192 轮折叠一次防止溢出 */
+    while (len - i >= 16) {
+        __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        __m128i zero = _mm_setzero_si128();
+        uint32_t lanes[4];
+        for (int n = 0; n < 8192 && len - i >= 16; n++, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+            lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(v, zero));
+            hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(v, zero));
+        }
+        _mm_storeu_si128((__m128i *)lanes, _mm_add_epi32(lo, hi));
+        acc += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    for (; len - i >= 8; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, 8);
+        acc += (w & 0xFFFFFFFF) + (w >> 32);
+    }
+    for (; len - i >= 2; i += 2) {
+        uint16_t w;
+        memcpy(&w, data + i, 2);
+        acc += w;
+    }
+    if (i < len) {
+        /* 奇数长度，末字节补零（与 16 位读法的字节序一致） */
+        uint16_t w = 0;
+        memcpy(&w, data + i, 1);
+        acc += w;
+    }
+
+    /* 折叠到 32 位，中间和还能继续累加 */
+    while (acc >> 32) {
+        acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+    }
+    return (unsigned int)acc;
+}
+
+unsigned short inet_fold(unsigned int sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (unsigned short)~sum;
+}
+
+/* ========== CRC32C ========== */
+
+#define CRC32C_POLY 0x82F63B78 /* Castagnoli 多项式，反射形式 */
+
+/* slice-by-8：crc_table[k][n] 是字节 n 后面再跟 k 个零字节的 CRC，每轮查 8 张表处理 8 字节 */
+static unsigned int crc_table[8][256];
+static int crc_table_ready;
+
+static void crc32c_init_table(void) {
+    for (unsigned int n = 0; n < 256; n++) {
+        unsigned int c = n;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        crc_table[0][n] = c;
+    }
+    for (unsigned int n = 0; n < 256; n++) {
+        for (int k = 1; k < 8; k++) {
+            unsigned int c = crc_table[k - 1][n];
+            crc_table[k][n] = crc_table[0][c & 0xFF] ^ (c >> 8);
+        }
+    }
+    crc_table_ready = 1;
+}
+
+unsigned int crc32c_table_update(unsigned int crc, const void *buf, int len) {
+    const unsigned char *data = buf;
+    int i = 0;
+
+    if (!crc_table_ready) {
+        crc32c_init_table();
+    }
+    /* 按小端读 8 字节，与逐字节处理的顺序一致 */
+    for (; len - i >= 8; i += 8) {
+        unsigned int lo = crc ^ (data[i] | data[i + 1] << 8 | data[i + 2] << 16 | (unsigned int)data[i + 3] << 24);
+        unsigned int hi = data[i + 4] | data[i + 5] << 8 | data[i + 6] << 16 | (unsigned int)data[i + 7] << 24;
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^
+              crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^
+              crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+    }
+    for (; i < len; i++) {
+        crc = crc_table[0][(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef HAVE_CRC32_INSN
+__attribute__((target("sse4.2")))
+static unsigned int crc32c_hw_update(unsigned int crc, const void *buf, int len) {
+    const unsigned char *data = buf;
+    uint64_t c = crc;
+    int i = 0;
+
+    for (; len - i >= 8; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, 8);
+        c = _mm_crc32_u64(c, w);
+    }
+    for (; i < len; i++) {
+        c = _mm_crc32_u8((unsigned int)c, data[i]);
+    }
+    return (unsigned int)c;
+}
+#endif
+
+int crc32c_hw_available(void) {
+#ifdef HAVE_CRC32_INSN
+    static int cached = -1;
+    if (cached < 0) {
+        cached = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    }
+    return cached;
+#else
+    return 0;
+#endif
+}
+
+unsigned int crc32c_update(unsigned int crc, const void *buf, int len) {
+#ifdef HAVE_CRC32_INSN
+    if (crc32c_hw_available()) {
+        return crc32c_hw_update(crc, buf, len);
+    }
+#endif
+    return crc32c_table_update(crc, buf, len);
+}
+
+/* ========== 分组校验和 ========== */
+
+int checksum_alg = CHECKSUM;
+
+unsigned int pkt_payload_sum(const struct pkt *p) {
+    int len = p->length;
+
+    if (len < 0 || len > MAX_PAYLOAD) {
+        len = 0;
+    }
+    if (checksum_alg == CSUM_CRC32C) {
+        return crc32c_update(0xFFFFFFFF, p->payload, len);
+    }
+    return inet_sum(p->payload, len, 0);
+}
+
+/* 把头部并入载荷的中间值；checksum 字段不参与，所以不必先清零 */
+int pkt_checksum_finish(const struct pkt *p, unsigned int payload_sum) {
+    int header[3];
+
+    header[0] = p->seqnum;
+    header[1] = p->acknum;
+    header[2] = p->length;
+    if (checksum_alg == CSUM_CRC32C) {
+        return (int)~crc32c_update(payload_sum, header, sizeof(header));
+    }
+    return inet_fold(inet_sum(header, sizeof(header), payload_sum));
+}
+
+int pkt_checksum(const struct pkt *p) {
+    return pkt_checksum_finish(p, pkt_payload_sum(p));
+}
+
+int pkt_is_corrupt(const struct pkt *p) {
+    if (p->length < 0 || p->length > MAX_PAYLOAD) {
+        return 1;
+    }
+    return pkt_checksum(p) != p->checksum;
+}
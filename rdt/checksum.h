@@ -0,0 +1,47 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include "rdt.h"
+
+/**
+ * 分组完整性校验，供 abp.c、gbn.c 和 sr.c 共用。
+ *
+ * 两种算法，默认值编译时用 -DCHECKSUM=CSUM_CRC32C 选择，运行时由 checksum_alg 决定：
+ *   CSUM_INET   RFC 1071 Internet 校验和（反码和），按 16 字节 SSE2 / 8 字节展开累加
+ *   CSUM_CRC32C Castagnoli CRC，CPU 支持 SSE4.2 时用 crc32 指令，否则查表
+ *
+ * Internet 校验和查不出同一列上成对翻转的比特，误码率模型（模拟器的 -e）一个分组
+ * 翻转几个比特时，每千个损坏的分组就有几个漏过去；所以 -e 时模拟器改用 CRC32C，
+ * 它能查出 32 位以内的所有突发错误，其余错误漏过的概率约 2^-32。
+ * checksum_alg 要在第一个分组之前设好，发送方缓存的载荷中间值按它计算。
+ *
+ * 校验范围是载荷在前、头部（seqnum, acknum, length）在后，不含 checksum 字段本身。
+ * 先算载荷的中间值，再把头部并进去：重传或搭载ACK时只有头部变化，
+ * 发送方缓存每一帧的 pkt_payload_sum()，用 pkt_checksum_finish() 补上头部即可。
+ */
+
+#define CSUM_INET 0
+#define CSUM_CRC32C 1
+
+#ifndef CHECKSUM
+#define CHECKSUM CSUM_INET
+#endif
+
+extern int checksum_alg; /* CSUM_INET 或 CSUM_CRC32C，初值为 CHECKSUM */
+
+/* Internet 校验和：inet_sum 返回未折叠的中间和，可以分段累加 */
+unsigned int inet_sum(const void *buf, int len, unsigned int sum);
+unsigned short inet_fold(unsigned int sum);
+
+/* CRC32C：crc 为寄存器值，整段计算时初值 0xFFFFFFFF，结果取反 */
+unsigned int crc32c_update(unsigned int crc, const void *buf, int len);
+unsigned int crc32c_table_update(unsigned int crc, const void *buf, int len);
+int crc32c_hw_available(void);
+
+/* 分组校验和 */
+unsigned int pkt_payload_sum(const struct pkt *p);
+int pkt_checksum_finish(const struct pkt *p, unsigned int payload_sum);
+int pkt_checksum(const struct pkt *p);
+int pkt_is_corrupt(const struct pkt *p);
+
+#endif
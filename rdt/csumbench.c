@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "checksum.h"
+
+/**
+ * 校验算法的吞吐量和检错能力对比：
+ *   ./csumbench.out [次数]
+ *
+ * 吞吐量：分别对 40 字节（单独ACK）、MAX_PAYLOAD 字节（满帧）和 64KB 缓冲计时。
+ * 检错：随机生成分组，按几种错误模式各破坏若干次，统计每种算法漏检的次数。
+ * 除了 checksum.c 的两种算法，也带上原来的逐字节 16 位循环和 abp.c 原来的字节和作对照。
+ */
+
+#define BENCH_BYTES (64 * 1024)
+
+/* xorshift64*，固定种子，结果可复现 */
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static unsigned long long rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+static int rng_below(int n) {
+    return (int)(rng_next() % n);
+}
+
+/* ========== 对照算法 ========== */
+
+/* gbn.c / sr.c 原来的写法：逐字节拼 16 位字，每步处理进位 */
+static unsigned int bytewise_inet(const unsigned char *data, int len) {
+    unsigned int sum = 0;
+    for (int i = 0; i < len; i += 2) {
+        sum += data[i] | (i + 1 < len ? data[i + 1] << 8 : 0);
+        if (sum & 0xFFFF0000) {
+            sum &= 0xFFFF;
+            sum++;
+        }
+    }
+    return ~sum & 0xFFFF;
+}
+
+/* abp.c 原来的校验：序号加确认号加载荷各字节 */
+static int abp_bytesum(const struct pkt *p) {
+    int sum = p->seqnum + p->acknum;
+    for (int i = 0; i < p->length; i++) {
+        sum += (unsigned char)p->payload[i];
+    }
+    return sum;
+}
+
+/* ========== 吞吐量 ========== */
+
+static double now(void) {
+    /* rdt.h 里有全局变量 time，不能包含 <time.h> */
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static volatile unsigned int sink;
+
+static void bench(const char *name, int len, const unsigned char *buf, int which) {
+    long iters = (256L * 1024 * 1024) / len;
+    double start = now();
+    unsigned int acc = 0;
+
+    for (long n = 0; n < iters; n++) {
+        switch (which) {
+        case 0:
+            acc += bytewise_inet(buf, len);
+            break;
+        case 1:
+            acc += inet_fold(inet_sum(buf, len, 0));
+            break;
+        case 2:
+            acc += crc32c_table_update(0xFFFFFFFF, buf, len);
+            break;
+        case 3:
+            acc += crc32c_update(0xFFFFFFFF, buf, len);
+            break;
+        }
+        acc += n; /* 防止循环不变量外提 */
+    }
+    sink = acc;
+
+    double elapsed = now() - start;
+    printf(" %-16s %6d bytes: %8.2f MB/s, %8.1f ns/call\n", name, len,
+           iters * (double)len / elapsed / 1e6, elapsed / iters * 1e9);
+}
+
+/* ========== 检错 ========== */
+
+enum { ALG_ABP, ALG_INET, ALG_CRC32C, NALG };
+static const char *alg_name[NALG] = {"abp byte sum", "inet", "crc32c"};
+
+static int alg_checksum(int alg, const struct pkt *p) {
+    const unsigned char *payload = (const unsigned char *)p->payload;
+    int header[3] = {p->seqnum, p->acknum, p->length};
+
+    switch (alg) {
+    case ALG_ABP:
+        return abp_bytesum(p);
+    case ALG_INET:
+        return inet_fold(inet_sum(header, sizeof(header), inet_sum(payload, p->length, 0)));
+    default:
+        return (int)~crc32c_update(crc32c_update(0xFFFFFFFF, payload, p->length), header, sizeof(header));
+    }
+}
+
+/* 校验范围内的第 i 字节：先载荷后头部，与 checksum.c 一致 */
+static unsigned char *covered_byte(struct pkt *p, int len, int i) {
+    if (i < len) {
+        return (unsigned char *)p->payload + i;
+    }
+    i -= len;
+    if (i < 4) {
+        return (unsigned char *)&p->seqnum + i;
+    }
+    if (i < 8) {
+        return (unsigned char *)&p->acknum + i - 4;
+    }
+    return (unsigned char *)&p->length + i - 8;
+}
+
+enum { ERR_EMULATOR, ERR_BIT1, ERR_BIT2, ERR_BURST32, ERR_SWAP16, ERR_BYTES4, NERR };
+static const char *err_name[NERR] = {
+    "emulator", "1 bit", "2 bits", "burst <= 32 bits", "swap 16-bit words", "4 random bytes",
+};
+
+/* 按错误模式破坏分组，长度字段保持不变（接收方会先检查长度范围） */
+static void corrupt(struct pkt *p, int mode) {
+    int len = p->length;
+    int nbits = (len + 12) * 8;
+
+    switch (mode) {
+    case ERR_EMULATOR:
+        /* emulator.c 的做法：改第一个载荷字节，或把序号/确认号改成 999999 */
+        switch (rng_below(3)) {
+        case 0:
+            p->payload[0] = p->payload[0] == 'Z' ? 'Y' : 'Z';
+            break;
+        case 1:
+            p->seqnum = 999999;
+            break;
+        default:
+            p->acknum = 999999;
+            break;
+        }
+        break;
+    case ERR_BIT1:
+    case ERR_BIT2: {
+        int b1 = rng_below(nbits - 32), b2;
+        *covered_byte(p, len, b1 / 8) ^= 1 << (b1 % 8);
+        if (mode == ERR_BIT2) {
+            do {
+                b2 = rng_below(nbits - 32);
+            } while (b2 == b1);
+            *covered_byte(p, len, b2 / 8) ^= 1 << (b2 % 8);
+        }
+        break;
+    }
+    case ERR_BURST32: {
+        /* 首尾两位必翻，中间随机 */
+        int blen = 2 + rng_below(31);
+        int start = rng_below(nbits - 32 - blen + 1);
+        for (int i = 0; i < blen; i++) {
+            if (i == 0 || i == blen - 1 || (rng_next() & 1)) {
+                *covered_byte(p, len, (start + i) / 8) ^= 1 << ((start + i) % 8);
+            }
+        }
+        break;
+    }
+    case ERR_SWAP16: {
+        /* 交换载荷里两个不同的 16 位字：反码和与顺序无关，一定漏检 */
+        int a, b;
+        unsigned short wa, wb;
+        do {
+            a = rng_below(len / 2);
+            b = rng_below(len / 2);
+            memcpy(&wa, p->payload + 2 * a, 2);
+            memcpy(&wb, p->payload + 2 * b, 2);
+        } while (wa == wb);
+        memcpy(p->payload + 2 * a, &wb, 2);
+        memcpy(p->payload + 2 * b, &wa, 2);
+        break;
+    }
+    default:
+        for (int i = 0; i < 4; i++) {
+            unsigned char *c = covered_byte(p, len, rng_below(len + 8));
+            *c ^= 1 + rng_below(255);
+        }
+        break;
+    }
+}
+
+static void random_pkt(struct pkt *p) {
+    memset(p, 0, sizeof(*p));
+    p->seqnum = rng_below(1024);
+    p->acknum = rng_below(1024);
+    p->length = MSG_SIZE * (1 + rng_below(MAX_MSS / MSG_SIZE));
+    /* 可打印字符，和 emulator 生成的消息一样 */
+    for (int i = 0; i < p->length; i++) {
+        p->payload[i] = 'a' + rng_below(26);
+    }
+}
+
+static void detection(long trials) {
+    printf("undetected corruptions out of %ld per pattern:\n", trials);
+    printf(" %-20s", "");
+    for (int alg = 0; alg < NALG; alg++) {
+        printf(" %14s", alg_name[alg]);
+    }
+    printf("\n");
+
+    for (int mode = 0; mode < NERR; mode++) {
+        long missed[NALG] = {0};
+        for (long n = 0; n < trials; n++) {
+            struct pkt p, bad;
+            int good[NALG];
+            random_pkt(&p);
+            for (int alg = 0; alg < NALG; alg++) {
+                good[alg] = alg_checksum(alg, &p);
+            }
+            bad = p;
+            corrupt(&bad, mode);
+            for (int alg = 0; alg < NALG; alg++) {
+                missed[alg] += alg_checksum(alg, &bad) == good[alg];
+            }
+        }
+        printf(" %-20s", err_name[mode]);
+        for (int alg = 0; alg < NALG; alg++) {
+            printf(" %14ld", missed[alg]);
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    long trials = argc > 1 ? atol(argv[1]) : 1000000;
+    static unsigned char buf[BENCH_BYTES];
+    int sizes[] = {40, MAX_PAYLOAD, BENCH_BYTES};
+
+    for (int i = 0; i < BENCH_BYTES; i++) {
+        buf[i] = (unsigned char)rng_next();
+    }
+
+    printf("crc32 instruction: %s\n", crc32c_hw_available() ? "yes" : "no (table)");
+    for (int s = 0; s < 3; s++) {
+        bench("bytewise inet", sizes[s], buf, 0);
+        bench("inet", sizes[s], buf, 1);
+        bench("crc32c table", sizes[s], buf, 2);
+        bench("crc32c", sizes[s], buf, 3);
+    }
+
+    detection(trials);
+    return 0;
+}
@@ -0,0 +1,3127 @@
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h> /* for malloc, free, srand, rand */
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h> /* for getopt */
+
+#include "rdt.h"
+#include "checksum.h"
+#include "threads.h"
+
+/*****************************************************************
+***************** NETWORK EMULATION CODE STARTS BELOW ***********
+The code below emulates the layer 3 and below network environment:
+  - emulates the tranmission and delivery (possibly with bit-level corruption
+    and packet loss) of packets across the layer 3/4 interface
+  - handles the starting/stopping of a timer, and generates timer
+    interrupts (resulting in calling students timer handler).
+  - generates message to be sent (passed from later 5 to 4)
+
+THERE IS NOT REASON THAT ANY STUDENT SHOULD HAVE TO READ OR UNDERSTAND
+THE CODE BELOW.  YOU SHOLD NOT TOUCH, OR REFERENCE (in your code) ANY
+OF THE DATA STRUCTURES BELOW.  If you're interested in how I designed
+the emulator, you're welcome to look at the code - but again, you should have
+to, and you defeinitely should not have to modify
+******************************************************************/
+
+struct event
+{
+    float evtime;       /* event time */
+    int evtype;         /* event type code */
+    int eventity;       /* entity where event occurs */
+    struct pkt *pktptr; /* ptr to packet (if any) assoc w/ this event */
+    unsigned long order; /* insertion order, see evbefore() */
+    int heapidx;        /* position of the event in the heap */
+    int evnode;         /* topology node the packet arrives at (FROM_ROUTER) */
+    int evsrc;          /* with -s or -P: who scheduled the event, */
+    unsigned long evseq; /* and how many it had scheduled before; see evbefore() */
+    int evcount;        /* FROM_LAYER5: messages that arrive together (-a trace) */
+};
+
+/* the event list is a binary min-heap rather than a sorted linked list, */
+/* so inserting and removing an event costs O(log n) however many flows */
+/* have events pending.  Without -s and -P events come out in the same   */
+/* order as from the list, where a new event went in front of events     */
+/* with the same time; see evbefore().                                   */
+/* There is one list, except in the parallel mode (-P) where every       */
+/* logical process has its own and evlist points at the one in use.      */
+struct evlist
+{
+    struct event **heap;
+    int nevents, cap;
+    unsigned long ninserted;
+};
+struct evlist mainlist;
+__thread struct evlist *evlist = &mainlist;
+
+void init(int argc, char **argv);
+void generate_next_arrival(int flow);
+void layer5_message(int id);
+void layer5_pull(int id);
+void insertevent(struct event *p);
+void removeevent(struct event *p);
+void schedule(struct event *p);
+void dispatch(struct event *eventptr);
+void trace_event(struct event *eventptr);
+void network_send(struct event *evptr);
+void pdes_run();
+void pdes_report();
+void lp_setup();
+void lp_start();
+void lp_dispatch(struct event *eventptr, long *ndone);
+int flow_quota(int flow);
+void pdes_flow_done(int flow);
+void sampler_options(char *arg);
+void sampler_start();
+void sample_until(float t);
+void sampler_close();
+void checkpoint_save(float next_event);
+void checkpoint_restore();
+void steady_observe(float latency);
+void print_steady();
+void crn_key(int what, int index, long ordinal);
+float jimsrand();
+
+/* possible events: */
+#define TIMER_INTERRUPT 0
+#define FROM_LAYER5 1
+#define FROM_LAYER3 2
+#define FROM_ROUTER 3 /* packet arrives at a router of the topology (-t) */
+#define TO_LAYER3 4   /* with -P: packet handed to the network process */
+#define NEVTYPES 5
+long nevents_done[NEVTYPES]; /* events carried out, by type */
+
+/* -DPROFILE=1 builds in a profiler of the event loop, see PROFILER    */
+/* below; without it the PROF_ macros are empty and cost nothing.      */
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+#if PROFILE
+/* the regions timed: one per event type (dispatch), then the loop   */
+/* as a whole and the callbacks; they nest, an event type includes   */
+/* the entity routine it calls and that routine the tolayer3 it makes */
+#define PROF_LOOP NEVTYPES
+#define PROF_A_OUTPUT (NEVTYPES + 1) /* B is the one after A */
+#define PROF_A_INPUT (NEVTYPES + 3)
+#define PROF_A_TIMER (NEVTYPES + 5)
+#define PROF_TOLAYER3 (NEVTYPES + 7)
+#define PROF_TOLAYER5 (NEVTYPES + 8)
+#define PROF_INSERT (NEVTYPES + 9)
+#define PROF_REMOVE (NEVTYPES + 10)
+#define PROF_TRACE (NEVTYPES + 11)
+#define NPROF (NEVTYPES + 12)
+#define PROF_DEPTHS 32  /* event list depth histogram, powers of two */
+#define PROF_SAMPLES 16 /* depth over time, see prof_event() */
+
+struct prof
+{
+    unsigned long long cycles[NPROF];
+    long calls[NPROF];
+    unsigned long long loop_start;
+    long depth[PROF_DEPTHS]; /* events taken off a list of 2^(b-1) .. 2^b - 1 */
+    double depth_sum;
+    int depth_max;
+    int nsamples;
+    long stride;             /* one sample every stride events */
+    float sample_time[PROF_SAMPLES];
+    int sample_depth[PROF_SAMPLES];
+};
+extern __thread struct prof prof;
+unsigned long long prof_now();
+void prof_event(struct event *p);
+void prof_merge(struct prof *to, struct prof *from);
+void prof_print();
+
+#define PROF_BEGIN() unsigned long long prof_start = prof_now()
+#define PROF_END(region) \
+    (prof.cycles[region] += prof_now() - prof_start, prof.calls[region]++)
+/* time a call; region is worked out before the call, which may free */
+/* the event it comes from                                           */
+#define PROF_CALL(region, call) \
+    do                          \
+    {                           \
+        int prof_region = (region); \
+        PROF_BEGIN();           \
+        call;                   \
+        PROF_END(prof_region);  \
+    } while (0)
+#define prof_loop_start() (prof.loop_start = prof_now())
+#define prof_loop_stop() (prof.cycles[PROF_LOOP] += prof_now() - prof.loop_start)
+#else
+#define PROF_BEGIN()
+#define PROF_END(region)
+#define PROF_CALL(region, call) call
+#define prof_event(p)
+#define prof_loop_start()
+#define prof_loop_stop()
+#define prof_print()
+#endif
+
+#define OFF 0
+#define ON 1
+#define A 0
+#define B 1
+
+int TRACE = 1;   /* for my debugging */
+int nflows = 1;  /* number of A -> B flows, -n option */
+int nentities = 2; /* two per flow: A = 2 * flow, B = 2 * flow + 1 */
+int nsim = 0;    /* number of messages from 5 to 4 so far */
+int nsimmax = 0; /* number of msgs to generate, then stop */
+__thread float time = (float)0.000; /* per thread with -P */
+unsigned int seed = 9999; /* -s option */
+int nthreads;    /* -P option, see the parallel simulation below */
+int lpmode;      /* -s or -P: run as the logical processes of -P, see there */
+float lossprob;    /* probability that a packet is dropped  */
+float corruptprob; /* probability that one bit is packet is flipped */
+float lambda;      /* arrival rate of messages from layer 5 */
+float bprob;       /* fraction of layer 5 messages generated at B, -b option */
+                   /* (0 is the unidirectional A to B transfer)            */
+int saturated;     /* -S: no timed arrivals, layer 5 always has a message */
+                   /* ready; with -b both sides send                      */
+int drain;         /* -F: after the last message, run on until every flow */
+                   /* has delivered everything and gone idle              */
+int nflows_open = -1; /* -F without -P: flows not completed, -1 until the */
+                      /* last message is generated                        */
+int nleft_timers, nleft_pkts, nleft_arrivals; /* -F: events freed at the end */
+int nleft_redundant; /* -F: packets in flight to flows that had completed */
+/* what the A and B sides sent into layer 3, and what became of it */
+struct traffic
+{
+    int ntolayer3;       /* number sent into layer 3 */
+    int nlost;           /* number lost in media */
+    int ncorrupt;        /* number corrupted by media*/
+    int nreordered;      /* held back by the reordering model */
+    int nduplicated;
+    long nbytes_header;  /* header bytes sent into layer 3 */
+    long nbytes_payload; /* payload bytes sent into layer 3 */
+};
+struct traffic traffic[2];
+int mss = MSG_SIZE;    /* largest packet payload, -m option */
+
+/* bottleneck link model, one per direction: links[A] carries A->B and    */
+/* links[B] carries B->A.  It is switched on with -r rate; without it the */
+/* channel is the original one (1 to 10 time units after the previous   */
+/* packet, no bandwidth limit and no buffer limit).                      */
+/* A packet of n bytes (header + payload) waits behind the packets      */
+/* already queued, takes n / rate time units to serialize and arrives    */
+/* delay time units after that.  The queue holds at most -q packets     */
+/* ("-q 8000b" for bytes, 0 for unlimited); a full queue drops the new   */
+/* packet (drop-tail), or with -Q red packets are dropped early with a   */
+/* probability that grows with the average queue size.                   */
+#define RED_WEIGHT 0.02 /* EWMA weight of the RED average; the usual 0.002 */
+                        /* is too slow for runs of a few thousand packets  */
+#define RED_MAXP 0.1    /* drop probability at the upper threshold */
+
+struct link
+{
+    float rate;       /* bytes per time unit, 0 = link model off */
+    float delay;      /* propagation delay */
+    int limit;        /* queue limit, 0 = unlimited */
+    int limit_bytes;  /* limit counts bytes instead of packets */
+    int red;          /* RED instead of drop-tail */
+    float busy_until; /* when the last queued packet leaves the link */
+    float *depart;    /* ring of departure times of the queued packets */
+    int *size;        /* and their sizes */
+    int qhead, qcount, qcap;
+    int qbytes;
+    double red_avg;   /* RED average queue size (in the limit's unit) */
+    /* statistics */
+    int nsent;          /* packets accepted onto the link */
+    long bytes_sent;
+    int ndrop_tail;     /* dropped because the queue was full */
+    int ndrop_red;      /* dropped early by RED */
+    int qmax;           /* largest queue seen by an arriving packet */
+    double busy_time;   /* total serialization time */
+    double sojourn_sum; /* total time spent queued + serializing */
+    double qdelay_sum;  /* total time spent waiting behind other packets */
+};
+struct link links[2];
+
+/* channel models, one state per direction like the links.  By default   */
+/* each packet is lost with probability lossprob and corrupted with       */
+/* probability corruptprob, independently of every other packet.          */
+/*   -l ge:p,r[,lg,lb]  Gilbert-Elliott bursty loss: the channel moves     */
+/*                      from good to bad with probability p and back with  */
+/*                      probability r per packet, and loses packets with   */
+/*                      probability lg in the good state (default 0) and   */
+/*                      lb in the bad state (default 1).                   */
+/*   -e ber             every bit of header and payload is flipped with    */
+/*                      probability ber, instead of the corruptprob model. */
+/*                      Several flips in one packet get past the Internet  */
+/*                      checksum now and then, so -e makes the entities    */
+/*                      use CRC32C (see checksum.h).                       */
+/* Both draw how long the current run lasts (packets in the current GE    */
+/* state, clean bits before the next flip) from a geometric distribution, */
+/* so a packet costs O(1) random numbers no matter how small p or ber is. */
+struct channel
+{
+    int ge_bad;         /* Gilbert-Elliott state */
+    long ge_left;       /* packets left in the current state */
+    long long ber_skip; /* clean bits before the next flipped bit */
+    /* statistics */
+    int npkts;          /* packets that went through the loss model */
+    int nbad;           /* ... while the channel was in the bad state */
+    long nflipped;      /* bits flipped by the BER model */
+};
+struct channel channels[2];
+int ge_on;              /* Gilbert-Elliott instead of the Bernoulli loss */
+double ge_p, ge_r;      /* good -> bad and bad -> good probabilities */
+double ge_loss_good, ge_loss_bad = 1.0;
+double ber;             /* bit error rate, 0 = corruptprob model */
+
+/* reordering and duplication, off by default.  With -o prob,depth a     */
+/* packet is held back by up to depth extra time units with probability   */
+/* prob, and the packets sent after it do not wait for it, so they can    */
+/* overtake it.  With -D prob a packet is delivered a second time, 1 to   */
+/* 10 time units after the first copy.                                    */
+float reorder_prob, reorder_depth;
+float dup_prob;
+
+/* arrival process of the layer 5 messages, -a option.  lambda is the    */
+/* mean time between the messages of a flow in every model but the trace. */
+/*   uniform             the original: gaps uniform on [0, 2*lambda]       */
+/*   poisson             exponential gaps, i.e. a Poisson process          */
+/*   onoff:alpha,on,off  Poisson arrivals during ON periods and none during */
+/*                       OFF periods, which last a Pareto(alpha) time with */
+/*                       means on and off; 1 < alpha < 2 gives heavy-tailed */
+/*                       bursts.  The rate while ON is raised so that       */
+/*                       lambda stays the mean gap.                         */
+/*   trace:file          replay a recorded trace of "timestamp size" lines  */
+/*                       ('#' starts a comment line).  The file is mmap'd   */
+/*                       and parsed in place, so it can be of any length.   */
+/*                       The records go to the flows in turn, a record of  */
+/*                       size bytes brings ceil(size / 20) messages, and    */
+/*                       times count from the first record.  The run ends  */
+/*                       with the trace if nsimmax is not reached first.    */
+#define ARRIVE_UNIFORM 0
+#define ARRIVE_POISSON 1
+#define ARRIVE_ONOFF 2
+#define ARRIVE_TRACE 3
+int arrivals;
+const char *arrival_name[] = {"uniform", "poisson", "onoff", "trace"};
+double onoff_alpha, onoff_on, onoff_off;
+struct trace
+{
+    const char *name;
+    const char *data, *end, *cur; /* the mapped file and the parse position */
+    long nrecords;  /* records read so far */
+    long nmsgs;     /* messages they bring */
+    double t0;      /* time stamp of the first record */
+} trace;
+
+/* time series of the protocol state, -T interval,file[,metric...]: the */
+/* METRIC_ values of rdt.h, summed over the entities, and two of the     */
+/* emulator's own.  See the sampler below.                               */
+#define SERIES_LINKQ NMETRICS        /* packets queued on the links (-r, -t) */
+#define SERIES_EVENTS (NMETRICS + 1) /* events pending */
+#define NSERIES (NMETRICS + 2)
+#define SERIES_ROWS 65536            /* samples kept before they are written out */
+const char *series_name[NSERIES] = {"inflight", "acked", "rcvbuf", "sendbuf", "timers",
+                                    "linkq", "events"};
+struct sampler
+{
+    FILE *fp;        /* NULL without -T */
+    const char *file;
+    int csv;         /* CSV rather than binary */
+    double interval;
+    double next;     /* time of the next sample */
+    int ncols;
+    int series[NSERIES]; /* what each column holds */
+    double *stime;   /* the buffer, one array per column */
+    int *col[NSERIES];
+    int nrows;
+    long nsamples;
+} sampler;
+
+/* checkpoints, -C interval,file and -R file; see below */
+struct checkpoint
+{
+    const char *file;    /* -C: written every interval time units */
+    double interval;
+    double next;         /* time of the next checkpoint */
+    int nwritten;
+    float last;          /* time of the latest one */
+    const char *restore; /* -R: the run starts from this one */
+    int restoring;       /* checkpoint_data() reads rather than writes */
+    FILE *fp;
+} ckpt;
+unsigned long nrand;     /* rand() calls so far, to put its state back */
+
+/* common random numbers, -k: every random decision is drawn from a    */
+/* stream of its own, keyed by what it is about; see crn_key() below  */
+#define CRN_ARRIVAL 0 /* flow, arrivals of the flow so far */
+#define CRN_QUEUE 1   /* direction, packets sent in the direction so far: RED */
+#define CRN_LOSS 2    /* the same: loss */
+#define CRN_DELAY 3   /* the same: delay and reordering */
+#define CRN_CORRUPT 4 /* the same: corruption */
+#define CRN_DUP 5     /* the same: duplication */
+#define CRN_HOP 6     /* hop, packets that came to the hop so far: RED and loss */
+int crn;
+
+/* steady-state runs, -c precision: nsimmax is only the most messages */
+/* the run may take; see the convergence test below                   */
+#define SS_MINI 5       /* observations per mini-batch (MSER-5) */
+#define SS_BATCHES 20   /* batches of the confidence intervals */
+#define SS_MIN_BATCH 10 /* mini-batches per batch at least */
+#define SS_T 2.093      /* Student's t for 19 degrees of freedom, 95% two-sided */
+struct steady
+{
+    double target;      /* relative half-width to reach, 0 = off */
+    int nobs;           /* observations in the current mini-batch */
+    double gap_sum, lat_sum;
+    float last;         /* time of the latest delivery */
+    double *gap, *lat;  /* mini-batch means of the gaps between deliveries */
+    int n, cap;         /* and of the latencies */
+    int next_check;     /* test again at this many mini-batches */
+    int warmup;         /* mini-batches MSER-5 discarded at the last test */
+    int batch;          /* and mini-batches per batch */
+    double gap_mean, gap_hw, lat_mean, lat_hw;
+    int converged;      /* messages generated when it converged, 0 = not yet */
+} steady;
+
+/* per entity state.  Delivery statistics: messages are delivered in the */
+/* order they were generated, so the n-th message handed to tolayer5 at  */
+/* one side is the n-th message generated at the other side, leaving out */
+/* those the protocol dropped (layer5_dropped) on the way.               */
+struct endpoint
+{
+    float *gentime;     /* layer 5 arrival time of every generated message */
+    char *genletter;    /* and the letter it was filled with, 0 once dropped */
+    int gencap;         /* room in gentime and genletter */
+    int ngenerated;     /* messages generated at this entity */
+    int ndropped;       /* of the generated, dropped by the protocol */
+    int ndelivered;     /* messages delivered to layer 5 at this entity */
+    int nmatched;       /* the peer's messages up to here are delivered or dropped */
+    int nmisdelivered;  /* deliveries that were not the expected message */
+    double latency_sum; /* sum of generation -> delivery delays */
+    float latency_max;
+    float last_arrival; /* latest in-order arrival scheduled at this entity */
+    float on_until;     /* -a onoff: end of the current ON period of the flow (A side) */
+    long narrivals;     /* -k: arrivals set up for the flow so far (A side) */
+    float last_delivery; /* time of the latest delivery to layer 5 */
+    int done;           /* -F: the flow (A side) has completed */
+    float done_time;    /* and when */
+    struct event *timer; /* pending timer interrupt, NULL if none */
+    unsigned long nposted;  /* with -s or -P: events scheduled by the entity */
+    unsigned long long rng; /* with -s or -P: random number stream of the flow (A side) */
+};
+struct endpoint *endpoints;
+
+/* multi-hop topology, -t file.  Without it A and B are connected by the */
+/* single channel (or link) above.  The file lists the links between     */
+/* nodes; the nodes A and B are where the entities sit, every other name */
+/* is a store-and-forward router:                                        */
+/*     # comment                                                         */
+/*     link A r1 40 5 20         name name rate delay [queue[b] [loss]] */
+/*     link r1 r2 10 20 8b 0.01                                          */
+/*     link r2 B 40 5                                                    */
+/*     route r1 B r2             at r1, packets for B go to r2           */
+/* A link is full duplex: each direction has its own queue (a struct     */
+/* link, so -q and -Q give the default queue limit and discipline) and   */
+/* loses packets with the given probability.  Rate 0 means no bandwidth  */
+/* limit.  Routes that are not listed follow the fewest hops.  The loss  */
+/* and corruption probabilities of the input still apply once per packet */
+/* when it is handed to layer 3.                                         */
+#define MAX_NODES 64
+#define NODE_NAME 16
+struct hop
+{
+    int from, to;   /* nodes */
+    struct link q;  /* queue, rate and propagation delay */
+    float loss;     /* loss probability on this hop */
+    int npkts;      /* packets that arrived at the queue */
+    int nlost;      /* lost on the wire */
+};
+char node_name[MAX_NODES][NODE_NAME];
+int nnodes;                   /* 0 = no topology */
+struct hop *hops;             /* two per link, one per direction */
+int nhops;
+int route[MAX_NODES][2];      /* hop to take from a node towards A or B, -1 if none */
+
+void print_stats();
+void print_link_stats(struct link *l, const char *from, const char *to);
+void print_topology_stats();
+void read_topology(const char *file);
+void hop_send(struct event *evptr, int node);
+void print_flow_stats(int to);
+void print_completion();
+int flow_check(int flow);
+int drain_check(int id);
+void free_events(struct evlist *l);
+void trace_open(const char *file);
+double jimsrand_open();
+long long geometric_skip(double q);
+long geometric_run(double q);
+float link_enqueue(struct link *l, int bytes);
+unsigned long long stream_next(unsigned long long *s);
+extern __thread unsigned long long *cur_rng;
+extern __thread double window_end;
+extern double lookahead;
+extern int nflows_active;
+extern int nnet;
+extern unsigned long long *net_rng;
+extern unsigned long *net_posted;
+int channel_lost(int from);
+int channel_flip_bits(int from, struct pkt *p, int nbytes);
+
+int main(int argc, char **argv)
+{
+    struct event *eventptr;
+    int i, id;
+    /* char c; // Unreferenced local variable removed */
+
+    init(argc, argv);
+    if (nthreads > 0)
+    {
+        pdes_run();
+        goto terminate;
+    }
+    if (ckpt.restore != NULL)
+        checkpoint_restore(); /* instead of what follows */
+    else if (lpmode)
+        lp_start();
+    else
+    {
+        for (i = 0; i < nentities; i++)
+            entity_init(i);
+        for (i = 0; i < nentities; i++)
+            layer5_pull(i); /* -S: the first messages */
+    }
+
+    prof_loop_start();
+    while (1)
+    {
+        if (evlist->nevents == 0)
+            break;
+        eventptr = evlist->heap[0]; /* get next event to simulate */
+        if (lpmode && eventptr->evtime >= window_end)
+        { /* -s: where -P would start a window, and stop */
+            if (nflows_active == 0)
+                break;
+            window_end = eventptr->evtime + lookahead / 2;
+        }
+        if (eventptr->evtime > ckpt.next)
+            checkpoint_save(eventptr->evtime);
+        prof_event(eventptr);
+        removeevent(eventptr); /* remove this event from event list */
+        if (TRACE >= 2)
+            PROF_CALL(PROF_TRACE, trace_event(eventptr));
+        if (eventptr->evtime > sampler.next)
+            sample_until(eventptr->evtime); /* -T: the state up to now */
+        time = eventptr->evtime; /* update time to next event time */
+        if (lpmode)
+        {
+            lp_dispatch(eventptr, nevents_done);
+            continue;
+        }
+        if (nsim == nsimmax)
+        {
+            if (!drain)
+                break; /* all done with simulation */
+            if (eventptr->evtype == FROM_LAYER5)
+            { /* -F: no more messages, the arrival stream ends here */
+                free(eventptr);
+                continue;
+            }
+        }
+        id = eventptr->eventity;
+        nevents_done[eventptr->evtype]++;
+        PROF_CALL(eventptr->evtype, dispatch(eventptr));
+        if (drain && nsim == nsimmax && drain_check(id))
+            break;
+    }
+    prof_loop_stop();
+
+terminate:
+   if (drain && nthreads == 0)
+       free_events(&mainlist); /* with -P, pdes_run() frees them */
+   printf(" Simulator terminated at time %f\n after sending %d msgs from layer5\n",time,nsim);
+   print_stats();
+   if (nthreads > 0)
+       pdes_report();
+   if (sampler.fp != NULL)
+       sampler_close();
+   if (ckpt.file != NULL)
+       printf(" checkpoints: %d written to %s, the last at time %f\n", ckpt.nwritten, ckpt.file,
+              ckpt.last);
+   prof_print();
+   return 0;
+}
+
+void trace_event(struct event *eventptr)
+{
+    printf("\nEVENT time: %f,", eventptr->evtime);
+    printf("  type: %d", eventptr->evtype);
+    if (eventptr->evtype == 0)
+        printf(", timerinterrupt  ");
+    else if (eventptr->evtype == 1)
+        printf(", fromlayer5 ");
+    else if (eventptr->evtype == FROM_ROUTER)
+        printf(", at router %s ", node_name[eventptr->evnode]);
+    else if (eventptr->evtype == TO_LAYER3)
+        printf(", tolayer3 ");
+    else
+        printf(", fromlayer3 ");
+    printf(" entity: %d\n", eventptr->eventity);
+}
+
+/* carry out one event taken off the event list; frees it unless it is */
+/* passed on                                                            */
+void dispatch(struct event *eventptr)
+{
+    struct pkt pkt2give;
+    int i;
+
+    if (eventptr->evtype == FROM_LAYER5)
+    {
+        generate_next_arrival(eventptr->eventity / 2); /* set up future arrival */
+        /* only a trace record brings several messages, and not with -P */
+        for (i = 0; i < eventptr->evcount && nsim < nsimmax; i++)
+            layer5_message(eventptr->eventity);
+    }
+    else if (eventptr->evtype == FROM_LAYER3)
+    {
+        pkt2give = *eventptr->pktptr;
+        PROF_CALL(PROF_A_INPUT + (eventptr->eventity & 1),
+                  entity_input(eventptr->eventity, pkt2give)); /* deliver packet */
+        free(eventptr->pktptr); /* free the memory for packet */
+        layer5_pull(eventptr->eventity); /* an ACK may have opened the window */
+    }
+    else if (eventptr->evtype == TO_LAYER3)
+    {
+        network_send(eventptr); /* the event is reused for the arrival */
+        return;
+    }
+    else if (eventptr->evtype == FROM_ROUTER)
+    {
+        hop_send(eventptr, eventptr->evnode); /* forward, the event is reused */
+        return;
+    }
+    else if (eventptr->evtype == TIMER_INTERRUPT)
+    {
+        endpoints[eventptr->eventity].timer = NULL;
+        PROF_CALL(PROF_A_TIMER + (eventptr->eventity & 1), entity_timerinterrupt(eventptr->eventity));
+        layer5_pull(eventptr->eventity);
+    }
+    else
+    {
+        printf("INTERNAL PANIC: unknown event type \n");
+    }
+    free(eventptr);
+}
+
+/* layer 5 of entity id hands it the next message */
+void layer5_message(int id)
+{
+    struct msg msg2give;
+    struct endpoint *ep = &endpoints[id];
+    int i, j;
+
+    /* fill in msg to give with string of same letter; with -s or -P */
+    /* the letters go round per flow, and with -P nsim is only added */
+    /* up at the end                                                 */
+    if (lpmode)
+        j = (endpoints[id & ~1].ngenerated + endpoints[id | 1].ngenerated) % 26;
+    else
+        j = nsim % 26;
+    if (nthreads == 0)
+        nsim++;
+    for (i = 0; i < 20; i++)
+        msg2give.data[i] = 97 + j;
+    if (TRACE > 2)
+    {
+        printf("          MAINLOOP: data given to student: ");
+        for (i = 0; i < 20; i++)
+            printf("%c", msg2give.data[i]);
+        printf("\n");
+    }
+    if (ep->ngenerated == ep->gencap)
+    {
+        ep->gencap = ep->gencap ? 2 * ep->gencap : 64;
+        ep->gentime = (float *)realloc(ep->gentime, ep->gencap * sizeof(float));
+        ep->genletter = (char *)realloc(ep->genletter, ep->gencap);
+    }
+    ep->genletter[ep->ngenerated] = msg2give.data[0];
+    ep->gentime[ep->ngenerated++] = time;
+    PROF_CALL(PROF_A_OUTPUT + (id & 1), entity_output(id, msg2give));
+}
+
+/* the protocol at entity id discards the message layer 5 has just    */
+/* handed it; tolayer5 at the peer then matches deliveries past it    */
+void layer5_dropped(int id)
+{
+    struct endpoint *ep = &endpoints[id];
+
+    if (ep->ngenerated == 0 || ep->genletter[ep->ngenerated - 1] == 0)
+        return; /* nothing handed over, or dropped already */
+    ep->genletter[ep->ngenerated - 1] = 0;
+    ep->ndropped++;
+}
+
+void print_stats()
+{
+    int to, id, ngen, ndel, nmis, ndrop;
+    double lsum;
+    float lmax;
+    struct traffic *ta = &traffic[A], *tb = &traffic[B];
+    long nheader = ta->nbytes_header + tb->nbytes_header;
+    long nbytes = nheader + ta->nbytes_payload + tb->nbytes_payload;
+
+    printf(" packets to layer3: %d (A: %d, B: %d), lost: %d, corrupted: %d\n",
+           ta->ntolayer3 + tb->ntolayer3, ta->ntolayer3, tb->ntolayer3,
+           ta->nlost + tb->nlost, ta->ncorrupt + tb->ncorrupt);
+    if (nbytes > 0)
+        printf(" bytes to layer3: %ld, header bytes: %ld (%.1f%%), mss: %d\n",
+               nbytes, nheader, 100.0 * nheader / nbytes, mss);
+    /* the load the arrival process really offered, next to what it */
+    /* was asked for                                                 */
+    if (!saturated && time > 0)
+    {
+        printf(" arrivals: %s, offered load: %f msgs/time, %f bytes/time",
+               arrival_name[arrivals], nsim / time, nsim * MSG_SIZE / time);
+        if (arrivals == ARRIVE_TRACE)
+            printf(", trace records: %ld\n", trace.nrecords);
+        else
+            printf(" (nominal %f msgs/time)\n", nflows / lambda);
+    }
+    for (to = B; to >= A; to--)
+    {
+        /* totals over the flows, to = B is the A->B direction */
+        ngen = ndel = nmis = ndrop = 0;
+        lsum = 0;
+        lmax = 0;
+        for (id = to; id < nentities; id += 2)
+        {
+            ngen += endpoints[id ^ 1].ngenerated;
+            ndrop += endpoints[id ^ 1].ndropped;
+            ndel += endpoints[id].ndelivered;
+            nmis += endpoints[id].nmisdelivered;
+            lsum += endpoints[id].latency_sum;
+            if (endpoints[id].latency_max > lmax)
+                lmax = endpoints[id].latency_max;
+        }
+        if (to == A && ngen == 0)
+            break; /* nothing flowed from B to A */
+        printf(" %c->%c: msgs generated: %d, delivered to layer5: %d, goodput: %f msgs/time",
+               to == B ? 'A' : 'B', to == B ? 'B' : 'A', ngen, ndel,
+               time > 0 ? ndel / time : 0.0);
+        if (ndel > 0)
+            printf(", mean latency: %f, max latency: %f", lsum / ndel, lmax);
+        if (nmis > 0)
+            printf(", WRONG or out of order: %d", nmis);
+        if (ndrop > 0)
+            printf(", dropped by the sender: %d", ndrop);
+        printf("\n");
+        if (nflows > 1)
+            print_flow_stats(to);
+    }
+    if (steady.target > 0)
+        print_steady();
+    if (drain)
+        print_completion();
+    printf(" events: %ld timer interrupts, %ld arrivals from layer 5, %ld packet arrivals",
+           nevents_done[TIMER_INTERRUPT], nevents_done[FROM_LAYER5], nevents_done[FROM_LAYER3]);
+    if (nnodes > 0)
+        printf(", %ld router hops", nevents_done[FROM_ROUTER]);
+    if (lpmode)
+        printf(", %ld hand-offs to the network", nevents_done[TO_LAYER3]);
+    printf("\n");
+    if (reorder_prob > 0 || dup_prob > 0)
+        printf(" reordered: %d, duplicated: %d\n", ta->nreordered + tb->nreordered,
+               ta->nduplicated + tb->nduplicated);
+    for (to = A; to <= B; to++)
+        if (links[to].rate > 0)
+            print_link_stats(&links[to], to == A ? "A" : "B", to == A ? "B" : "A");
+    if (nnodes > 0)
+        print_topology_stats();
+    for (to = A; to <= B; to++)
+        if ((ge_on || ber > 0) && channels[to].npkts > 0)
+            printf(" channel %c->%c: pkts: %d, in bad state: %d (%.1f%%), flipped bits: %ld\n",
+                   'A' + to, 'B' - to, channels[to].npkts, channels[to].nbad,
+                   100.0 * channels[to].nbad / channels[to].npkts, channels[to].nflipped);
+    protocol_stats();
+}
+
+/* per flow goodput and Jain's fairness index (sum x)^2 / (n sum x^2), */
+/* which is 1 when every flow gets the same goodput and 1/n when one   */
+/* flow gets everything                                                 */
+void print_flow_stats(int to)
+{
+    int f;
+    double x, sum = 0, sumsq = 0, min = -1, max = 0;
+
+    for (f = 0; f < nflows; f++)
+    {
+        x = time > 0 ? endpoints[2 * f + to].ndelivered / time : 0.0;
+        sum += x;
+        sumsq += x * x;
+        if (min < 0 || x < min)
+            min = x;
+        if (x > max)
+            max = x;
+        if (nflows <= 16)
+        {
+            printf("   flow %d: delivered: %d, goodput: %f", f, endpoints[2 * f + to].ndelivered, x);
+            if (endpoints[2 * f + to].ndelivered > 0)
+                printf(", mean latency: %f", endpoints[2 * f + to].latency_sum /
+                                                 endpoints[2 * f + to].ndelivered);
+            printf("\n");
+        }
+    }
+    printf("   %d flows, goodput per flow: min %f, mean %f, max %f, Jain fairness index: %f\n",
+           nflows, min, sum / nflows, max, sumsq > 0 ? sum * sum / (nflows * sumsq) : 1.0);
+}
+
+/* -F: how long the transfer took and what it left behind */
+void print_completion()
+{
+    int f, ndone = 0, nbusy = 0;
+    long nundelivered = 0, ndropped = 0;
+    float start, end, fct, first = -1, last = 0, idle = 0, fct_min = -1, fct_max = 0;
+    double fct_sum = 0;
+    struct endpoint *a, *b;
+
+    for (f = 0; f < nflows; f++)
+    {
+        a = &endpoints[2 * f];
+        b = &endpoints[2 * f + 1];
+        if (b->ndelivered < a->ngenerated - a->ndropped)
+            nundelivered += a->ngenerated - a->ndropped - b->ndelivered;
+        if (a->ndelivered < b->ngenerated - b->ndropped)
+            nundelivered += b->ngenerated - b->ndropped - a->ndelivered;
+        ndropped += a->ndropped + b->ndropped;
+        if (!a->done && (!lpmode || flow_quota(f) > 0))
+            nbusy++;
+        if (!a->done || a->ngenerated + b->ngenerated == 0)
+            continue;
+        ndone++;
+        /* from the first message of the flow to its last delivery */
+        start = a->ngenerated > 0 ? a->gentime[0] : b->gentime[0];
+        if (b->ngenerated > 0 && b->gentime[0] < start)
+            start = b->gentime[0];
+        end = a->last_delivery > b->last_delivery ? a->last_delivery : b->last_delivery;
+        fct = end - start;
+        fct_sum += fct;
+        if (fct_min < 0 || fct < fct_min)
+            fct_min = fct;
+        if (fct > fct_max)
+            fct_max = fct;
+        if (first < 0 || start < first)
+            first = start;
+        if (end > last)
+            last = end;
+        if (a->done_time > idle)
+            idle = a->done_time;
+    }
+    if (ndone > 0)
+        printf(" completion: first msg at %f, last delivery at %f, flow completion time: %f,"
+               " idle at %f\n", first, last, last - first, idle);
+    if (ndone > 1)
+        printf("   %d flows, completion time per flow: min %f, mean %f, max %f\n",
+               ndone, fct_min, fct_sum / ndone, fct_max);
+    if (nbusy > 0)
+        printf(" completion: INCOMPLETE, the event list ran dry with %d flows still busy\n", nbusy);
+    if (nundelivered > 0 || nleft_timers > 0 || nleft_pkts > 0)
+        printf(" completion: LEAKS: undelivered msgs: %ld, timers still set: %d,"
+               " packets still in flight: %d\n", nundelivered, nleft_timers, nleft_pkts);
+    else
+    {
+        printf(" completion: no leaks, every msg %s, no timers set, ",
+               ndropped > 0 ? "the sender did not drop delivered" : "delivered");
+        if (nleft_redundant > 0)
+            printf("only redundant packets in flight: %d\n", nleft_redundant);
+        else
+            printf("no packets in flight\n");
+    }
+}
+
+void print_link_stats(struct link *l, const char *from, const char *to)
+{
+    double busy = l->busy_time;
+
+    if (l->busy_until > time) /* still serializing when the run stopped */
+        busy -= l->busy_until - time;
+    printf(" link %s->%s: pkts: %d, bytes: %ld, utilization: %.1f%%, drops: %d tail, %d red\n",
+           from, to, l->nsent, l->bytes_sent,
+           time > 0 ? 100.0 * busy / time : 0.0, l->ndrop_tail, l->ndrop_red);
+    /* Little's law: the mean number of packets at the link is the */
+    /* total time they spent there divided by the run time         */
+    if (l->nsent > 0)
+        printf("   mean queue: %.2f pkts, max queue: %d %s, mean queueing delay: %f\n",
+               time > 0 ? l->sojourn_sum / time : 0.0, l->qmax, l->limit_bytes ? "bytes" : "pkts",
+               l->qdelay_sum / l->nsent);
+}
+
+void init(int argc, char **argv) /* initialize the simulator */
+{
+    int i, c;
+    float sum, avg;
+    float jimsrand();
+
+    char *topology = NULL;
+
+    links[A].delay = 5.0; /* the original channel averages 5.5 time units */
+    sampler.next = HUGE_VAL; /* no samples without -T */
+    ckpt.next = HUGE_VAL;    /* and no checkpoints without -C */
+    while ((c = getopt(argc, argv, "b:m:r:d:q:Q:l:e:o:D:n:t:P:s:Sa:FT:C:R:c:k")) != -1)
+    {
+        switch (c)
+        {
+        case 'b':
+            bprob = atof(optarg);
+            if (bprob < 0 || bprob > 1)
+            {
+                fprintf(stderr, "fraction of msgs from B must be in [0, 1]\n");
+                exit(1);
+            }
+            break;
+        case 'm':
+            mss = atoi(optarg) / MSG_SIZE * MSG_SIZE;
+            if (mss < MSG_SIZE || mss > MAX_MSS)
+            {
+                fprintf(stderr, "mss must be between %d and %d bytes\n", MSG_SIZE, MAX_MSS);
+                exit(1);
+            }
+            break;
+        case 'r':
+            links[A].rate = atof(optarg);
+            break;
+        case 'd':
+            links[A].delay = atof(optarg);
+            break;
+        case 'q':
+            links[A].limit = atoi(optarg);
+            links[A].limit_bytes = optarg[strlen(optarg) - 1] == 'b';
+            break;
+        case 'Q':
+            if (strcmp(optarg, "red") == 0)
+                links[A].red = 1;
+            else if (strcmp(optarg, "droptail") != 0)
+            {
+                fprintf(stderr, "queue discipline must be droptail or red\n");
+                exit(1);
+            }
+            break;
+        case 'l':
+            if (sscanf(optarg, "ge:%lf,%lf,%lf,%lf", &ge_p, &ge_r, &ge_loss_good, &ge_loss_bad) < 2 ||
+                ge_p < 0 || ge_p > 1 || ge_r <= 0 || ge_r > 1)
+            {
+                fprintf(stderr, "loss model must be ge:p,r[,loss_good,loss_bad] with 0 < r <= 1\n");
+                exit(1);
+            }
+            ge_on = 1;
+            break;
+        case 'e':
+            ber = atof(optarg);
+            if (ber < 0 || ber >= 1)
+            {
+                fprintf(stderr, "bit error rate must be in [0, 1)\n");
+                exit(1);
+            }
+            if (ber > 0)
+                checksum_alg = CSUM_CRC32C;
+            break;
+        case 'o':
+            if (sscanf(optarg, "%f,%f", &reorder_prob, &reorder_depth) != 2 ||
+                reorder_prob < 0 || reorder_prob > 1 || reorder_depth <= 0)
+            {
+                fprintf(stderr, "reordering must be given as probability,depth with 0 <= probability <= 1 and depth > 0\n");
+                exit(1);
+            }
+            break;
+        case 'D':
+            dup_prob = atof(optarg);
+            if (dup_prob < 0 || dup_prob > 1)
+            {
+                fprintf(stderr, "duplication probability must be in [0, 1]\n");
+                exit(1);
+            }
+            break;
+        case 'n':
+            nflows = atoi(optarg);
+            if (nflows < 1)
+            {
+                fprintf(stderr, "number of flows must be at least 1\n");
+                exit(1);
+            }
+            nentities = 2 * nflows;
+            break;
+        case 't':
+            topology = optarg;
+            break;
+        case 'P':
+            nthreads = atoi(optarg);
+            if (nthreads < 1)
+            {
+                fprintf(stderr, "number of threads must be at least 1\n");
+                exit(1);
+            }
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            lpmode = 1;
+            break;
+        case 'S':
+            saturated = 1;
+            break;
+        case 'F':
+            drain = 1;
+            break;
+        case 'k':
+            crn = 1;
+            break;
+        case 'T':
+            sampler_options(optarg);
+            break;
+        case 'C':
+            ckpt.interval = atof(optarg);
+            ckpt.file = strchr(optarg, ',');
+            if (ckpt.interval <= 0 || ckpt.file == NULL)
+            {
+                fprintf(stderr, "-C needs interval,file with interval > 0\n");
+                exit(1);
+            }
+            ckpt.file++;
+            break;
+        case 'R':
+            ckpt.restore = optarg;
+            break;
+        case 'c':
+            steady.target = atof(optarg);
+            if (steady.target <= 0 || steady.target >= 1)
+            {
+                fprintf(stderr, "precision must be a relative half-width in (0, 1)\n");
+                exit(1);
+            }
+            break;
+        case 'a':
+            if (strcmp(optarg, "uniform") == 0)
+                arrivals = ARRIVE_UNIFORM;
+            else if (strcmp(optarg, "poisson") == 0)
+                arrivals = ARRIVE_POISSON;
+            else if (strncmp(optarg, "trace:", 6) == 0)
+            {
+                arrivals = ARRIVE_TRACE;
+                trace.name = optarg + 6;
+            }
+            else if (sscanf(optarg, "onoff:%lf,%lf,%lf", &onoff_alpha, &onoff_on, &onoff_off) == 3 &&
+                     onoff_alpha > 1 && onoff_on > 0 && onoff_off >= 0)
+                arrivals = ARRIVE_ONOFF;
+            else
+            {
+                fprintf(stderr, "arrivals must be uniform, poisson, onoff:alpha,on,off with alpha > 1,"
+                                " or trace:file\n");
+                exit(1);
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-b fraction_of_msgs_from_B] [-m mss] [-r link_rate]"
+                            " [-d link_delay] [-q queue_limit[b]] [-Q droptail|red]"
+                            " [-l ge:p,r[,loss_good,loss_bad]] [-e bit_error_rate]"
+                            " [-o reorder_prob,depth] [-D duplicate_prob] [-n flows]"
+                            " [-t topology_file] [-P threads] [-s seed] [-S]"
+                            " [-a uniform|poisson|onoff:alpha,on,off|trace:file] [-F]"
+                            " [-T interval,file[,metric...]] [-C interval,file] [-R file]"
+                            " [-c precision] [-k]\n",
+                    argv[0]);
+            exit(1);
+        }
+    }
+    if (links[A].red && links[A].limit <= 0)
+    {
+        fprintf(stderr, "RED needs a queue limit (-q)\n");
+        exit(1);
+    }
+    links[B] = links[A]; /* both directions get the same link */
+    if (topology != NULL)
+    {
+        if (links[A].rate > 0 || reorder_prob > 0 || dup_prob > 0)
+        {
+            fprintf(stderr, "-t cannot be combined with -r, -o or -D\n");
+            exit(1);
+        }
+        read_topology(topology); /* the hops take -q and -Q from links[A] */
+    }
+    if (arrivals == ARRIVE_TRACE)
+    {
+        if (nthreads > 0 || saturated)
+        {
+            fprintf(stderr, "-a trace cannot be combined with -P or -S\n");
+            exit(1);
+        }
+        trace_open(trace.name);
+    }
+    if (nthreads > 0 && (sampler.file != NULL || ckpt.file != NULL || ckpt.restore != NULL ||
+                         steady.target > 0))
+    {
+        fprintf(stderr, "-T, -C, -R and -c cannot be combined with -P\n");
+        exit(1);
+    }
+    /* -s runs what -P runs, on one thread; -a trace and -c, which -P */
+    /* does not take, keep the one rand() sequence                      */
+    lpmode = (lpmode || nthreads > 0) && arrivals != ARRIVE_TRACE && steady.target <= 0;
+    if (sampler.file != NULL)
+        sampler_start();
+    if (ckpt.file != NULL)
+        ckpt.next = ckpt.interval;
+
+    printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
+    printf("Enter the number of messages to simulate: ");
+    scanf("%d", &nsimmax);
+    printf("Enter  packet loss probability [enter 0.0 for no loss]:");
+    scanf("%f", &lossprob);
+    printf("Enter packet corruption probability [0.0 for no corruption]:");
+    scanf("%f", &corruptprob);
+   printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
+   scanf("%f",&lambda);
+   printf("Enter TRACE:");
+   scanf("%d",&TRACE);
+
+   srand(seed);              /* init random number generator */
+   sum = (float)0.0;         /* test random number generator for students */
+   for (i=0; i<1000; i++)
+      sum=sum+jimsrand();    /* jimsrand() should be uniform in [0,1] */
+   avg = sum/(float)1000.0;
+   if (avg < 0.25 || avg > 0.75) {
+        printf("It is likely that random number generation on your machine\n");
+        printf("is different from what this emulator expects.  Please take\n");
+        printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
+        exit(0);
+    }
+
+   endpoints = (struct endpoint *)calloc(nentities, sizeof(struct endpoint));
+
+   for (i = A; i <= B; i++)
+   {
+       channels[i].ge_left = geometric_run(ge_p);   /* start in the good state */
+       channels[i].ber_skip = geometric_skip(ber);
+   }
+
+   time=(float)0.0;                    /* initialize time to 0.0 */
+   if (lpmode)
+       lp_setup();
+   else if (!saturated) /* with -s or -P lp_start() does */
+       for (i = 0; i < nflows; i++)
+           generate_next_arrival(i);  /* initialize event list, one arrival stream per flow */
+}
+
+/****************************************************************************/
+/* jimsrand(): return a float in range [0,1].  The routine below is used to */
+/* isolate all random number generation in one location.  We assume that the*/
+/* system-supplied rand() function return an int in therange [0,mmm]        */
+/****************************************************************************/
+float jimsrand()
+{
+    double mmm = RAND_MAX;     /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
+    float x;                   /* individual students may need to change mmm */
+    if (cur_rng != NULL)       /* -P: the stream of the current process */
+        return (float)((stream_next(cur_rng) >> 40) / 16777216.0);
+    nrand++;
+    x = (float)(rand() / mmm); /* x should be uniform in [0,1] */
+    return (x);
+}
+
+/* uniform on (0,1), so that its logarithm is finite */
+double jimsrand_open()
+{
+    if (cur_rng != NULL)
+        return ((stream_next(cur_rng) >> 11) + 0.5) / 9007199254740992.0;
+    nrand++;
+    return (rand() + 1.0) / (RAND_MAX + 2.0);
+}
+
+/* -k: the random numbers that follow, up to the next call, come from */
+/* a stream of their own, seeded by -s and the key.  A decision then   */
+/* depends on what it is about (the n-th packet sent from A, the n-th  */
+/* arrival of a flow), not on how many random numbers the protocol     */
+/* made the emulator draw before: two protocols run with the same seed */
+/* see the same arrivals, and their n-th packets in each direction are */
+/* lost, corrupted and delayed alike.  This positively correlates the  */
+/* results of a paired comparison, which lowers the variance of their  */
+/* difference (make crn).  Without -k it does nothing.                 */
+__thread unsigned long long crn_state;
+
+void crn_key(int what, int index, long ordinal)
+{
+    unsigned long long s;
+
+    if (!crn)
+        return;
+    s = seed * 0x2545F4914F6CDD1DULL ^ ((unsigned long long)what << 56) ^
+        ((unsigned long long)index << 40) ^ (unsigned long long)ordinal;
+    stream_next(&s);
+    crn_state = stream_next(&s);
+    cur_rng = &crn_state;
+}
+
+/* number of failures before the first success of probability q */
+long long geometric_skip(double q)
+{
+    double n;
+
+    if (q <= 0)
+        return LLONG_MAX;
+    if (q >= 1)
+        return 0;
+    n = floor(log(jimsrand_open()) / log1p(-q));
+    return n < (double)LLONG_MAX ? (long long)n : LLONG_MAX;
+}
+
+/* length of a run that ends after each packet with probability q (>= 1) */
+long geometric_run(double q)
+{
+    long long n = geometric_skip(q);
+    return n < LONG_MAX - 1 ? (long)n + 1 : LONG_MAX;
+}
+
+/********************* CHANNEL MODELS *******************/
+
+/* decide whether the channel loses the next packet from "from" */
+int channel_lost(int from)
+{
+    struct channel *c = &channels[from];
+
+    c->npkts++;
+    if (!ge_on)
+        return jimsrand() < lossprob;
+
+    if (c->ge_left == 0)
+    { /* the current state is over, switch and draw how long the next lasts */
+        c->ge_bad = !c->ge_bad;
+        c->ge_left = geometric_run(c->ge_bad ? ge_r : ge_p);
+    }
+    if (c->ge_left != LONG_MAX)
+        c->ge_left--;
+    if (c->ge_bad)
+        c->nbad++;
+    return jimsrand() < (c->ge_bad ? ge_loss_bad : ge_loss_good);
+}
+
+/* flip the bits that the BER model hits among the first nbytes of the   */
+/* packet; the count of clean bits carries over from one packet to the    */
+/* next.  Returns the number of bits flipped.                             */
+int channel_flip_bits(int from, struct pkt *p, int nbytes)
+{
+    struct channel *c = &channels[from];
+    unsigned char *bytes = (unsigned char *)p;
+    long long nbits = 8LL * nbytes, pos = 0;
+    int nflipped = 0;
+
+    if (nbytes > (int)sizeof(struct pkt))
+        nbits = 8LL * sizeof(struct pkt);
+    while (c->ber_skip < nbits - pos)
+    {
+        pos += c->ber_skip;
+        bytes[pos / 8] ^= 1 << (pos % 8);
+        pos++;
+        nflipped++;
+        c->ber_skip = geometric_skip(ber);
+    }
+    c->ber_skip -= nbits - pos;
+    c->nflipped += nflipped;
+    return nflipped;
+}
+
+/********************* EVENT HANDLINE ROUTINES *******/
+/*  The next set of routines handle the event list   */
+/*****************************************************/
+
+/* Pareto distributed time with shape alpha > 1 and the given mean */
+double pareto(double alpha, double mean)
+{
+    return mean * (alpha - 1) / alpha / pow(jimsrand_open(), 1 / alpha);
+}
+
+void trace_open(const char *file)
+{
+    struct stat st;
+    int fd = open(file, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        perror(file);
+        exit(1);
+    }
+    trace.data = trace.cur = trace.end = NULL;
+    if (st.st_size > 0)
+    {
+        trace.data = (const char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (trace.data == MAP_FAILED)
+        {
+            perror(file);
+            exit(1);
+        }
+        madvise((void *)trace.data, st.st_size, MADV_SEQUENTIAL);
+        trace.cur = trace.data;
+        trace.end = trace.data + st.st_size;
+    }
+    close(fd);
+}
+
+/* the next field of the current trace line, 0 if the line has no more */
+int trace_field(double *x)
+{
+    char buf[64], *stop;
+    int n = 0;
+
+    while (trace.cur < trace.end && (*trace.cur == ' ' || *trace.cur == '\t' || *trace.cur == '\r'))
+        trace.cur++;
+    while (trace.cur < trace.end && !isspace((unsigned char)*trace.cur) && n < (int)sizeof(buf) - 1)
+        buf[n++] = *trace.cur++;
+    buf[n] = 0;
+    *x = strtod(buf, &stop);
+    return n > 0 && stop == buf + n;
+}
+
+/* read the next record of the trace; returns 0 at the end of the file */
+int trace_next(double *t, long *size)
+{
+    double x;
+    int record;
+
+    while (trace.cur < trace.end)
+    {
+        if (isspace((unsigned char)*trace.cur))
+        {
+            trace.cur++;
+            continue;
+        }
+        record = *trace.cur != '#';
+        if (record)
+        {
+            if (!trace_field(t) || !trace_field(&x) || x < 0)
+            {
+                fprintf(stderr, "%s: bad record %ld, expected \"timestamp size\"\n", trace.name,
+                        trace.nrecords + 1);
+                exit(1);
+            }
+            *size = (long)x;
+            if (trace.nrecords++ == 0)
+                trace.t0 = *t;
+        }
+        while (trace.cur < trace.end && *trace.cur != '\n') /* the rest of the line */
+            trace.cur++;
+        if (record)
+            return 1;
+    }
+    return 0;
+}
+
+void generate_next_arrival(int flow)
+{
+    double x, t, gap;
+    long size;
+    int count = 1;
+    struct endpoint *ep = &endpoints[2 * flow];
+    struct event *evptr;
+
+    if (TRACE > 2)
+        printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
+    crn_key(CRN_ARRIVAL, flow, ep->narrivals++);
+
+    switch (arrivals)
+    {
+    case ARRIVE_POISSON:
+        x = -lambda * log(jimsrand_open());
+        break;
+    case ARRIVE_ONOFF:
+        /* exponential gaps at the ON rate; a gap that runs past the end */
+        /* of the ON period is drawn again in the next one, which the    */
+        /* exponential distribution allows as it has no memory           */
+        gap = lambda * onoff_on / (onoff_on + onoff_off);
+        x = -gap * log(jimsrand_open());
+        while (time + x > ep->on_until)
+        {
+            x = ep->on_until + pareto(onoff_alpha, onoff_off) - time;
+            ep->on_until = time + x + pareto(onoff_alpha, onoff_on);
+            x += -gap * log(jimsrand_open());
+        }
+        break;
+    case ARRIVE_TRACE:
+        if (!trace_next(&t, &size))
+        {
+            if (trace.nmsgs < nsimmax)
+                nsimmax = trace.nmsgs; /* stop once the last record is in */
+            return;
+        }
+        flow = (trace.nrecords - 1) % nflows;
+        count = size > MSG_SIZE ? (size + MSG_SIZE - 1) / MSG_SIZE : 1;
+        trace.nmsgs += count;
+        x = t - trace.t0 - time;
+        if (x < 0)
+            x = 0; /* records out of order arrive at once */
+        break;
+    default:
+        x = lambda * jimsrand() * 2; /* x is uniform on [0,2*lambda] */
+                                     /* having mean of lambda        */
+    }
+    evptr = (struct event *)malloc(sizeof(struct event));
+    evptr->evtime = (float)(time + x);
+    evptr->evtype = FROM_LAYER5;
+    evptr->evcount = count;
+    evptr->pktptr = NULL; /* checkpoint_events() saves a packet only where there is one */
+    if (bprob > 0 && (jimsrand() < bprob))
+        evptr->eventity = 2 * flow + B;
+    else
+        evptr->eventity = 2 * flow + A;
+    schedule(evptr);
+}
+
+/* has layer 5 handed the flow of entity id its last message? */
+int layer5_done(int id)
+{
+    int f = id / 2;
+
+    if (lpmode)
+        return endpoints[2 * f].ngenerated + endpoints[2 * f + 1].ngenerated >= flow_quota(f);
+    return nsim >= nsimmax;
+}
+
+/* -F: a flow that has generated its last message is complete once both */
+/* entities have nothing left to send or acknowledge; what they dropped */
+/* is never coming.  Returns 1 when the flow has just completed.        */
+int flow_check(int flow)
+{
+    struct endpoint *a = &endpoints[2 * flow];
+
+    if (a->done || !entity_idle(2 * flow) || !entity_idle(2 * flow + 1))
+        return 0;
+    a->done = 1;
+    a->done_time = time;
+    return 1;
+}
+
+/* -F without -s or -P, after an event at entity id: returns 1 when every flow */
+/* has completed.  Flows with no event left are looked at once, right    */
+/* after the last message.                                               */
+int drain_check(int id)
+{
+    int f;
+
+    if (nflows_open < 0)
+    {
+        nflows_open = nflows;
+        for (f = 0; f < nflows; f++)
+            nflows_open -= flow_check(f);
+    }
+    else
+        nflows_open -= flow_check(id / 2);
+    return nflows_open == 0;
+}
+
+/* with -S, the pull that replaces the arrivals: hand entity id messages */
+/* for as long as its protocol would take them.  Called after every event */
+/* that may have made room, i.e. packets and timeouts at the entity.     */
+void layer5_pull(int id)
+{
+    int f = id / 2;
+
+    if (!saturated || ((id & 1) == B && bprob <= 0))
+        return;
+    while (entity_ready(id))
+    {
+        if (!lpmode)
+        {
+            if (nsim == nsimmax)
+                return;
+            layer5_message(id);
+            continue;
+        }
+        if (endpoints[2 * f].ngenerated + endpoints[2 * f + 1].ngenerated == flow_quota(f))
+            return;
+        layer5_message(id);
+        if (endpoints[2 * f].ngenerated + endpoints[2 * f + 1].ngenerated == flow_quota(f))
+            pdes_flow_done(f);
+    }
+}
+
+/* does event a come out of the event list before event b?  With -s or */
+/* -P events at the same time go as -P runs them: the flows first, as  */
+/* they may still hand the network packets for that time, then by who */
+/* scheduled them and in what order, which does not depend on how the  */
+/* processes are interleaved.                                          */
+int evbefore(struct event *a, struct event *b)
+{
+    int neta, netb;
+
+    if (a->evtime != b->evtime)
+        return a->evtime < b->evtime;
+    if (!lpmode)
+        return a->order > b->order; /* the later one first, as the sorted list did */
+    neta = a->evtype == TO_LAYER3 || a->evtype == FROM_ROUTER;
+    netb = b->evtype == TO_LAYER3 || b->evtype == FROM_ROUTER;
+    if (neta != netb)
+        return netb;
+    if (a->evsrc != b->evsrc)
+        return a->evsrc < b->evsrc;
+    return a->evseq < b->evseq;
+}
+
+void evheap_set(int i, struct event *p)
+{
+    evlist->heap[i] = p;
+    p->heapidx = i;
+}
+
+/* move the event at i up or down until the heap is ordered again */
+void evheap_fix(int i)
+{
+    struct event **heap = evlist->heap, *p = heap[i];
+    int child;
+
+    while (i > 0 && evbefore(p, heap[(i - 1) / 2]))
+    {
+        evheap_set(i, heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    while ((child = 2 * i + 1) < evlist->nevents)
+    {
+        if (child + 1 < evlist->nevents && evbefore(heap[child + 1], heap[child]))
+            child++;
+        if (!evbefore(heap[child], p))
+            break;
+        evheap_set(i, heap[child]);
+        i = child;
+    }
+    evheap_set(i, p);
+}
+
+void insertevent(struct event *p)
+{
+    PROF_BEGIN();
+
+    if (TRACE > 2)
+    {
+        printf("            INSERTEVENT: time is %lf\n", time);
+        printf("            INSERTEVENT: future time will be %lf\n", p->evtime);
+    }
+    if (evlist->nevents == evlist->cap)
+    {
+        evlist->cap = evlist->cap ? 2 * evlist->cap : 256;
+        evlist->heap = (struct event **)realloc(evlist->heap, evlist->cap * sizeof(struct event *));
+    }
+    p->order = evlist->ninserted++;
+    evheap_set(evlist->nevents++, p);
+    evheap_fix(evlist->nevents - 1);
+    PROF_END(PROF_INSERT);
+}
+
+/* take an event out of the event list; the caller frees it */
+void removeevent(struct event *p)
+{
+    int i = p->heapidx;
+    PROF_BEGIN();
+
+    evlist->nevents--;
+    if (i < evlist->nevents)
+    {
+        evheap_set(i, evlist->heap[evlist->nevents]);
+        evheap_fix(i);
+    }
+    PROF_END(PROF_REMOVE);
+}
+
+/* -F: free what is left on an event list, counting what it was */
+void free_events(struct evlist *l)
+{
+    struct event *p;
+    int i;
+
+    for (i = 0; i < l->nevents; i++)
+    {
+        p = l->heap[i];
+        if (p->evtype == TIMER_INTERRUPT)
+        {
+            nleft_timers++;
+            endpoints[p->eventity].timer = NULL;
+        }
+        else if (p->evtype == FROM_LAYER5)
+            nleft_arrivals++;
+        else
+        {
+            /* everything of a completed flow is delivered and acknowledged, */
+            /* so what is still on its way, like the cumulative ACK GBN      */
+            /* repeats, or a duplicate, is redundant rather than a leak      */
+            if (endpoints[p->eventity & ~1].done)
+                nleft_redundant++;
+            else
+                nleft_pkts++;
+            free(p->pktptr);
+        }
+        free(p);
+    }
+    l->nevents = 0;
+}
+
+void printevlist()
+{
+    int i;
+    printf("--------------\nEvent List Follows (heap order):\n");
+    for (i = 0; i < evlist->nevents; i++)
+    {
+    printf("Event time: %f, type: %d entity: %d\n",evlist->heap[i]->evtime,evlist->heap[i]->evtype,evlist->heap[i]->eventity);
+    }
+    printf("--------------\n");
+}
+
+/********************* PROFILER *******************/
+
+#if PROFILE
+/* Built with -DPROFILE=1, the simulator counts the calls of the event  */
+/* loop, of every event type and of the callbacks, and the cycles they  */
+/* take: the time stamp counter on x86, elsewhere the monotonic clock   */
+/* in nanoseconds.  Reading the counter costs some 20 cycles, so short  */
+/* regions such as insertevent come out somewhat high.  It also records */
+/* how deep the event list is whenever an event comes off it.  With -P  */
+/* every thread profiles on its own and the counts are added up.        */
+__thread struct prof prof;
+
+static const char *prof_name[NPROF] = {
+    "timer interrupt events", "layer 5 arrival events", "layer 3 arrival events",
+    "router hop events", "layer 3 hand-off events", "event loop",
+    "A output", "B output", "A input", "B input", "A timer interrupt", "B timer interrupt",
+    "tolayer3", "tolayer5", "insertevent", "removeevent", "trace output",
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PROF_UNIT "cycles"
+unsigned long long prof_now()
+{
+    return __builtin_ia32_rdtsc();
+}
+#else
+#define PROF_UNIT "ns"
+unsigned long long prof_now()
+{
+    return threads_clock_ns();
+}
+#endif
+
+/* p is the next event of the list and still on it.  The depth over   */
+/* time is kept in PROF_SAMPLES samples whatever the length of the    */
+/* run: one every stride events, and when they are all taken, every   */
+/* other one goes and the stride doubles.                             */
+void prof_event(struct event *p)
+{
+    int n = evlist->nevents, b = 0;
+    long nev = ++prof.calls[PROF_LOOP];
+    int i;
+
+    while (b < PROF_DEPTHS - 1 && n >> b)
+        b++;
+    prof.depth[b]++;
+    prof.depth_sum += n;
+    if (n > prof.depth_max)
+        prof.depth_max = n;
+    if (prof.stride == 0)
+        prof.stride = 1;
+    if (nev % prof.stride != 0)
+        return;
+    prof.sample_time[prof.nsamples] = p->evtime;
+    prof.sample_depth[prof.nsamples++] = n;
+    if (prof.nsamples == PROF_SAMPLES)
+    {
+        for (i = 0; i < PROF_SAMPLES / 2; i++)
+        {
+            prof.sample_time[i] = prof.sample_time[2 * i + 1];
+            prof.sample_depth[i] = prof.sample_depth[2 * i + 1];
+        }
+        prof.nsamples = PROF_SAMPLES / 2;
+        prof.stride *= 2;
+    }
+}
+
+/* add up the profiles of two threads; the samples of the depth over */
+/* time stay those of the first                                      */
+void prof_merge(struct prof *to, struct prof *from)
+{
+    int i;
+
+    for (i = 0; i < NPROF; i++)
+    {
+        to->cycles[i] += from->cycles[i];
+        to->calls[i] += from->calls[i];
+    }
+    for (i = 0; i < PROF_DEPTHS; i++)
+        to->depth[i] += from->depth[i];
+    to->depth_sum += from->depth_sum;
+    if (from->depth_max > to->depth_max)
+        to->depth_max = from->depth_max;
+    if (to->nsamples == 0)
+    {
+        to->nsamples = from->nsamples;
+        memcpy(to->sample_time, from->sample_time, sizeof(to->sample_time));
+        memcpy(to->sample_depth, from->sample_depth, sizeof(to->sample_depth));
+    }
+}
+
+/* the regions by the cycles they took, most first */
+void prof_print()
+{
+    int order[NPROF], n = 0, i, r;
+    double loop = prof.cycles[PROF_LOOP] > 0 ? (double)prof.cycles[PROF_LOOP] : 1;
+    long nev = prof.calls[PROF_LOOP];
+
+    for (r = 0; r < NPROF; r++)
+    {
+        if (prof.calls[r] == 0)
+            continue;
+        for (i = n++; i > 0 && prof.cycles[order[i - 1]] < prof.cycles[r]; i--)
+            order[i] = order[i - 1];
+        order[i] = r;
+    }
+    printf(" profile (%s; regions nest, an event type includes the callbacks it makes):\n",
+           PROF_UNIT);
+    printf("   %-24s %12s %16s %7s %12s\n", "region", "calls", PROF_UNIT, "% loop", "per call");
+    for (i = 0; i < n; i++)
+    {
+        r = order[i];
+        printf("   %-24s %12ld %16llu %6.1f%% %12.1f\n", prof_name[r], prof.calls[r],
+               prof.cycles[r], 100 * prof.cycles[r] / loop,
+               (double)prof.cycles[r] / prof.calls[r]);
+    }
+    if (nev == 0)
+        return;
+    printf(" event list depth%s: mean %.1f, max %d\n", nthreads > 0 ? " (per process)" : "",
+           prof.depth_sum / nev, prof.depth_max);
+    for (i = 1; i < PROF_DEPTHS; i++)
+        if (prof.depth[i] > 0)
+            printf("   %8ld .. %-8ld %5.1f%% of the events\n", 1L << (i - 1), (1L << i) - 1,
+                   100.0 * prof.depth[i] / nev);
+    printf(" event list depth over time%s:\n", nthreads > 0 ? " (thread 0)" : "");
+    for (i = 0; i < prof.nsamples; i++)
+        printf("   time %14f: %d events\n", prof.sample_time[i], prof.sample_depth[i]);
+}
+#endif
+
+/********************* TIME SERIES *******************/
+
+/* -T adds no events: nothing changes between two events, so before an  */
+/* event is carried out the main loop takes the samples that fall       */
+/* before it, each the state after every event up to the sample time.   */
+/* The samples go into a buffer of SERIES_ROWS rows, one array per      */
+/* column, which is written out when it is full and at the end.  A file */
+/* ending in .csv gets a header line and one line per sample; any other */
+/* gets a text line "rdt-series time <metric>..." and then blocks of an */
+/* int n, n doubles (the times) and n ints for each metric in turn.     */
+/* A metric the protocol does not have is -1.                           */
+void sampler_options(char *arg)
+{
+    char *tok = strtok(arg, ",");
+    int i;
+
+    sampler.interval = tok != NULL ? atof(tok) : 0;
+    sampler.file = strtok(NULL, ",");
+    if (sampler.interval <= 0 || sampler.file == NULL)
+    {
+        fprintf(stderr, "-T needs interval,file with interval > 0\n");
+        exit(1);
+    }
+    while ((tok = strtok(NULL, ",")) != NULL)
+    {
+        for (i = 0; i < NSERIES && strcmp(tok, series_name[i]) != 0; i++)
+            ;
+        if (i == NSERIES)
+        {
+            fprintf(stderr, "unknown metric %s, the metrics are", tok);
+            for (i = 0; i < NSERIES; i++)
+                fprintf(stderr, " %s", series_name[i]);
+            fprintf(stderr, "\n");
+            exit(1);
+        }
+        sampler.series[sampler.ncols++] = i;
+    }
+    if (sampler.ncols == 0) /* all of them */
+        for (sampler.ncols = 0; sampler.ncols < NSERIES; sampler.ncols++)
+            sampler.series[sampler.ncols] = sampler.ncols;
+}
+
+/* with -R the file is the one the checkpoint was taken in, */
+/* checkpoint_restore() cuts it back to where it was then  */
+void sampler_start()
+{
+    int i = strlen(sampler.file);
+
+    sampler.csv = i >= 4 && strcmp(sampler.file + i - 4, ".csv") == 0;
+    sampler.fp = fopen(sampler.file, ckpt.restore != NULL ? "r+b" : "wb");
+    if (sampler.fp == NULL)
+    {
+        perror(sampler.file);
+        exit(1);
+    }
+    sampler.stime = (double *)malloc(SERIES_ROWS * sizeof(double));
+    for (i = 0; i < sampler.ncols; i++)
+        sampler.col[i] = (int *)malloc(SERIES_ROWS * sizeof(int));
+    sampler.next = sampler.interval;
+    if (ckpt.restore != NULL)
+        return;
+    fprintf(sampler.fp, sampler.csv ? "time" : "rdt-series time");
+    for (i = 0; i < sampler.ncols; i++)
+        fprintf(sampler.fp, sampler.csv ? ",%s" : " %s", series_name[sampler.series[i]]);
+    fprintf(sampler.fp, "\n");
+}
+
+void sampler_flush()
+{
+    int i, r;
+
+    if (sampler.csv)
+        for (r = 0; r < sampler.nrows; r++)
+        {
+            fprintf(sampler.fp, "%f", sampler.stime[r]);
+            for (i = 0; i < sampler.ncols; i++)
+                fprintf(sampler.fp, ",%d", sampler.col[i][r]);
+            fprintf(sampler.fp, "\n");
+        }
+    else if (sampler.nrows > 0)
+    {
+        fwrite(&sampler.nrows, sizeof(int), 1, sampler.fp);
+        fwrite(sampler.stime, sizeof(double), sampler.nrows, sampler.fp);
+        for (i = 0; i < sampler.ncols; i++)
+            fwrite(sampler.col[i], sizeof(int), sampler.nrows, sampler.fp);
+    }
+    sampler.nrows = 0;
+}
+
+/* packets on link l that have not left it at time t */
+int link_backlog(struct link *l, float t)
+{
+    int n = l->qcount;
+
+    while (n > 0 && l->depart[(l->qhead + l->qcount - n) % l->qcap] <= t)
+        n--;
+    return n;
+}
+
+int series_value(int series, float t)
+{
+    int id, v, sum = 0;
+
+    if (series == SERIES_EVENTS)
+        return evlist->nevents + 1; /* and the one being carried out */
+    if (series == SERIES_LINKQ)
+    {
+        for (id = 0; id < nhops; id++)
+            sum += link_backlog(&hops[id].q, t);
+        if (links[A].rate > 0)
+            sum += link_backlog(&links[A], t) + link_backlog(&links[B], t);
+        return sum;
+    }
+    for (id = 0; id < nentities; id++)
+    {
+        v = entity_metric(id, series);
+        if (v < 0)
+            return -1;
+        sum += v;
+    }
+    return sum;
+}
+
+/* the samples before time t */
+void sample_until(float t)
+{
+    int i;
+
+    while (sampler.next < t)
+    {
+        if (sampler.nrows == SERIES_ROWS)
+            sampler_flush();
+        sampler.stime[sampler.nrows] = sampler.next;
+        for (i = 0; i < sampler.ncols; i++)
+            sampler.col[i][sampler.nrows] = series_value(sampler.series[i], sampler.next);
+        sampler.nrows++;
+        sampler.nsamples++;
+        sampler.next = sampler.interval * (sampler.nsamples + 1);
+    }
+}
+
+void sampler_close()
+{
+    sampler_flush();
+    fclose(sampler.fp);
+    printf(" time series: %ld samples every %f time units to %s\n", sampler.nsamples,
+           sampler.interval, sampler.file);
+}
+
+/********************* CHECKPOINTS *******************/
+
+/* -C interval,file writes the whole state of the simulation to file    */
+/* every interval time units, and -R file starts a run from it instead  */
+/* of from the beginning; the run then goes on exactly as the one that  */
+/* wrote it did, trace and statistics included, given the same options */
+/* and input.  A checkpoint is taken between two events, like a sample */
+/* of -T.  It holds the emulator's counters and models, the messages   */
+/* generated so far, the events with their packets (the heap as it is,  */
+/* timers by their place in it), the state of each protocol entity, as  */
+/* entity_checkpoint() writes it, and the number of rand() calls made:  */
+/* its state cannot be read, so a restore seeds it again and makes that */
+/* many calls.  The file is written under another name and renamed, so  */
+/* a run that dies while writing leaves the previous checkpoint intact. */
+/* The layout is that of this build's structures, it is not portable.   */
+#define CKPT_MAGIC "rdt checkpoint 2"
+
+/* write buf, or with -R read it back */
+void checkpoint_data(void *buf, int len)
+{
+    if (len <= 0)
+        return;
+    if (!ckpt.restoring)
+        fwrite(buf, 1, len, ckpt.fp);
+    else if (fread(buf, 1, len, ckpt.fp) != (size_t)len)
+    {
+        fprintf(stderr, "checkpoint %s is truncated\n", ckpt.restore);
+        exit(1);
+    }
+}
+
+/* a link and its queue of departure times */
+void checkpoint_link(struct link *l)
+{
+    checkpoint_data(l, sizeof(*l));
+    if (ckpt.restoring)
+    {
+        l->depart = (float *)malloc(l->qcap * sizeof(float));
+        l->size = (int *)malloc(l->qcap * sizeof(int));
+    }
+    checkpoint_data(l->depart, l->qcap * sizeof(float));
+    checkpoint_data(l->size, l->qcap * sizeof(int));
+}
+
+void checkpoint_events()
+{
+    struct event *p;
+    int i, n = mainlist.nevents;
+
+    checkpoint_data(&n, sizeof(n));
+    checkpoint_data(&mainlist.ninserted, sizeof(mainlist.ninserted));
+    if (ckpt.restoring)
+    {
+        mainlist.cap = n > 256 ? n : 256;
+        mainlist.heap = (struct event **)realloc(mainlist.heap, mainlist.cap * sizeof(struct event *));
+        mainlist.nevents = n;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (ckpt.restoring)
+            mainlist.heap[i] = (struct event *)malloc(sizeof(struct event));
+        p = mainlist.heap[i];
+        checkpoint_data(p, sizeof(*p));
+        if (p->pktptr == NULL)
+            continue;
+        if (ckpt.restoring)
+            p->pktptr = (struct pkt *)malloc(sizeof(struct pkt));
+        checkpoint_data(p->pktptr, sizeof(struct pkt));
+    }
+}
+
+void checkpoint_endpoint(struct endpoint *ep)
+{
+    int timer = ep->timer != NULL ? ep->timer->heapidx : -1;
+
+    checkpoint_data(ep, sizeof(*ep));
+    checkpoint_data(&timer, sizeof(timer));
+    if (ckpt.restoring)
+    {
+        ep->timer = timer >= 0 ? mainlist.heap[timer] : NULL;
+        ep->gencap = ep->ngenerated;
+        ep->gentime = (float *)malloc(ep->gencap * sizeof(float));
+        ep->genletter = (char *)malloc(ep->gencap);
+    }
+    checkpoint_data(ep->gentime, ep->ngenerated * sizeof(float));
+    checkpoint_data(ep->genletter, ep->ngenerated);
+}
+
+/* everything, in the same order both ways */
+void checkpoint_state()
+{
+    char magic[sizeof(CKPT_MAGIC)] = CKPT_MAGIC;
+    int config[5] = {nentities, nhops, (int)seed, mss, lpmode}, check[5];
+    long trace_pos = trace.cur - trace.data, sample_pos = 0;
+    int i;
+
+    memcpy(check, config, sizeof(config));
+    checkpoint_data(magic, sizeof(magic));
+    checkpoint_data(check, sizeof(check));
+    if (strcmp(magic, CKPT_MAGIC) != 0 || memcmp(check, config, sizeof(config)) != 0)
+    {
+        fprintf(stderr, "%s is not a checkpoint of a run with these options\n", ckpt.restore);
+        exit(1);
+    }
+    if (sampler.fp != NULL && !ckpt.restoring)
+    {
+        sampler_flush(); /* what was sampled so far stays in the file */
+        fflush(sampler.fp);
+        sample_pos = ftell(sampler.fp);
+    }
+
+    checkpoint_data(&time, sizeof(time));
+    checkpoint_data(&nsim, sizeof(nsim));
+    checkpoint_data(&nsimmax, sizeof(nsimmax)); /* a trace may have cut it */
+    checkpoint_data(&nrand, sizeof(nrand));
+    checkpoint_data(nevents_done, sizeof(nevents_done));
+    checkpoint_data(&nflows_open, sizeof(nflows_open));
+    if (lpmode)
+    {
+        checkpoint_data(net_rng, nnet * sizeof(*net_rng));
+        checkpoint_data(net_posted, nnet * sizeof(*net_posted));
+        checkpoint_data(&nflows_active, sizeof(nflows_active));
+        checkpoint_data(&window_end, sizeof(window_end));
+    }
+    checkpoint_data(traffic, sizeof(traffic));
+    checkpoint_data(channels, sizeof(channels));
+    checkpoint_link(&links[A]);
+    checkpoint_link(&links[B]);
+    for (i = 0; i < nhops; i++)
+    {
+        checkpoint_data(&hops[i].npkts, sizeof(hops[i].npkts));
+        checkpoint_data(&hops[i].nlost, sizeof(hops[i].nlost));
+        checkpoint_link(&hops[i].q);
+    }
+    checkpoint_data(&trace_pos, sizeof(trace_pos));
+    checkpoint_data(&trace.nrecords, sizeof(trace.nrecords));
+    checkpoint_data(&trace.nmsgs, sizeof(trace.nmsgs));
+    checkpoint_data(&trace.t0, sizeof(trace.t0));
+    if (trace.data != NULL)
+        trace.cur = trace.data + trace_pos;
+    checkpoint_data(&sampler.nsamples, sizeof(sampler.nsamples));
+    checkpoint_data(&sampler.next, sizeof(sampler.next));
+    checkpoint_data(&sample_pos, sizeof(sample_pos));
+    checkpoint_data(&ckpt.nwritten, sizeof(ckpt.nwritten));
+    checkpoint_data(&ckpt.last, sizeof(ckpt.last));
+    checkpoint_data(&steady, sizeof(steady));
+    if (ckpt.restoring)
+    {
+        steady.gap = (double *)malloc(steady.cap * sizeof(double));
+        steady.lat = (double *)malloc(steady.cap * sizeof(double));
+    }
+    checkpoint_data(steady.gap, steady.n * sizeof(double));
+    checkpoint_data(steady.lat, steady.n * sizeof(double));
+
+    checkpoint_events();
+    for (i = 0; i < nentities; i++)
+        checkpoint_endpoint(&endpoints[i]);
+    for (i = 0; i < nentities; i++)
+        entity_checkpoint(i, ckpt.restoring);
+
+    if (ckpt.restoring && sampler.fp != NULL)
+    {
+        if (ftruncate(fileno(sampler.fp), sample_pos) != 0)
+        {
+            perror(sampler.file);
+            exit(1);
+        }
+        fseek(sampler.fp, 0, SEEK_END);
+    }
+}
+
+/* the event at next_event is the next to be carried out */
+void checkpoint_save(float next_event)
+{
+    char *tmp = (char *)malloc(strlen(ckpt.file) + 5);
+
+    sprintf(tmp, "%s.tmp", ckpt.file);
+    ckpt.fp = fopen(tmp, "wb");
+    if (ckpt.fp == NULL)
+    {
+        perror(tmp);
+        exit(1);
+    }
+    ckpt.nwritten++;
+    ckpt.last = time;
+    checkpoint_state();
+    if (fclose(ckpt.fp) != 0 || rename(tmp, ckpt.file) != 0)
+    {
+        perror(ckpt.file);
+        exit(1);
+    }
+    free(tmp);
+    ckpt.next = ckpt.interval * (floor(next_event / ckpt.interval) + 1);
+}
+
+/* in place of entity_init() and the first pulls; init() has set up */
+/* the first arrivals, which the checkpoint replaces                */
+void checkpoint_restore()
+{
+    unsigned long n;
+
+    ckpt.fp = fopen(ckpt.restore, "rb");
+    if (ckpt.fp == NULL)
+    {
+        perror(ckpt.restore);
+        exit(1);
+    }
+    free_events(&mainlist);
+    nleft_timers = nleft_pkts = nleft_arrivals = nleft_redundant = 0;
+    ckpt.restoring = 1;
+    checkpoint_state();
+    ckpt.restoring = 0;
+    fclose(ckpt.fp);
+
+    srand(seed);
+    for (n = 0; n < nrand; n++)
+        rand();
+    if (ckpt.file != NULL && mainlist.nevents > 0)
+        ckpt.next = ckpt.interval * (floor(mainlist.heap[0]->evtime / ckpt.interval) + 1);
+    fprintf(stderr, "restored %s at time %f\n", ckpt.restore, time);
+}
+
+/********************* STEADY STATE *******************/
+
+/* With -c the run stops generating messages once goodput and mean      */
+/* latency are known to within the given relative half-width of a 95%  */
+/* confidence interval.  Every delivery to layer 5, in either direction */
+/* and of any flow, is one observation of the latency and of the gap    */
+/* since the delivery before, whose mean is the inverse of the goodput. */
+/* They are averaged over mini-batches of SS_MINI deliveries.  A test   */
+/* first drops the warm-up: by MSER-5, the first d mini-batches, d at   */
+/* most half of them, such that the rest have the least variance of     */
+/* their mean (the larger d of the two series).  What is left is cut   */
+/* into SS_BATCHES batches, and the batch means give the intervals.     */
+/* The test runs whenever the number of mini-batches has grown by a     */
+/* tenth, so it costs O(1) per delivery; when it passes, nsimmax is set */
+/* to the messages generated so far and the run ends as it would there. */
+
+/* d minimizing the variance of the mean of x[d..n-1], d <= n/2 */
+int mser(const double *x, int n)
+{
+    double sum = 0, sumsq = 0, m, best = -1;
+    int d, dbest = 0;
+
+    for (d = n - 1; d >= 0; d--)
+    {
+        sum += x[d];
+        sumsq += x[d] * x[d];
+        if (d > n / 2)
+            continue;
+        m = n - d;
+        if (best < 0 || (sumsq - sum * sum / m) / (m * m) <= best)
+        {
+            best = (sumsq - sum * sum / m) / (m * m);
+            dbest = d;
+        }
+    }
+    return dbest;
+}
+
+/* mean and confidence half-width of the batch means of x[from..] */
+void batch_means(const double *x, int from, double *mean, double *hw)
+{
+    double b, sum = 0, sumsq = 0;
+    int i, j;
+
+    for (i = 0; i < SS_BATCHES; i++)
+    {
+        b = 0;
+        for (j = 0; j < steady.batch; j++)
+            b += x[from + i * steady.batch + j];
+        b /= steady.batch;
+        sum += b;
+        sumsq += b * b;
+    }
+    *mean = sum / SS_BATCHES;
+    *hw = SS_T * sqrt(fmax(sumsq - sum * sum / SS_BATCHES, 0) / (SS_BATCHES - 1) / SS_BATCHES);
+}
+
+void steady_check()
+{
+    int d = mser(steady.gap, steady.n), dl = mser(steady.lat, steady.n);
+
+    steady.next_check = steady.n + steady.n / 10 + 1;
+    if (dl > d)
+        d = dl;
+    if (steady.n - d < SS_BATCHES * SS_MIN_BATCH)
+        return;
+    steady.warmup = d;
+    steady.batch = (steady.n - d) / SS_BATCHES;
+    d = steady.n - steady.batch * SS_BATCHES; /* the remainder goes with the warm-up */
+    batch_means(steady.gap, d, &steady.gap_mean, &steady.gap_hw);
+    batch_means(steady.lat, d, &steady.lat_mean, &steady.lat_hw);
+    if (steady.gap_hw <= steady.target * steady.gap_mean &&
+        steady.lat_hw <= steady.target * steady.lat_mean)
+    {
+        steady.converged = nsim;
+        nsimmax = nsim;
+    }
+}
+
+void steady_observe(float latency)
+{
+    steady.gap_sum += time - steady.last;
+    steady.lat_sum += latency;
+    steady.last = time;
+    if (++steady.nobs < SS_MINI)
+        return;
+    if (steady.n == steady.cap)
+    {
+        steady.cap = steady.cap ? 2 * steady.cap : 1024;
+        steady.gap = (double *)realloc(steady.gap, steady.cap * sizeof(double));
+        steady.lat = (double *)realloc(steady.lat, steady.cap * sizeof(double));
+    }
+    steady.gap[steady.n] = steady.gap_sum / SS_MINI;
+    steady.lat[steady.n++] = steady.lat_sum / SS_MINI;
+    steady.gap_sum = steady.lat_sum = 0;
+    steady.nobs = 0;
+    if (steady.n >= steady.next_check && !steady.converged)
+        steady_check();
+}
+
+void print_steady()
+{
+    double g = steady.gap_mean > 0 ? 1 / steady.gap_mean : 0;
+
+    if (steady.batch == 0)
+    {
+        printf(" steady state: too few deliveries (%d) to test, %d needed after the warm-up\n",
+               steady.n * SS_MINI, SS_BATCHES * SS_MIN_BATCH * SS_MINI);
+        return;
+    }
+    if (steady.converged)
+        printf(" steady state: converged after %d msgs", steady.converged);
+    else
+        printf(" steady state: NOT converged within %d msgs", nsim);
+    printf(", warm-up: %d deliveries (MSER-5), %d batches of %d\n", steady.warmup * SS_MINI,
+           SS_BATCHES, steady.batch * SS_MINI);
+    printf("   goodput: %f +- %f msgs/time (%.2f%%), mean latency: %f +- %f (%.2f%%),"
+           " target %.2f%%\n",
+           g, g * g * steady.gap_hw, 100 * steady.gap_hw / steady.gap_mean, steady.lat_mean,
+           steady.lat_hw, 100 * steady.lat_hw / steady.lat_mean, 100 * steady.target);
+}
+
+/********************* LINK MODEL *******************/
+
+/* queue a packet of the given size on the link; returns the time at which */
+/* it has been serialized, or -1 if the queue dropped it                   */
+float link_enqueue(struct link *l, int bytes)
+{
+    int occupancy, i;
+    float start;
+
+    /* packets that have left the link by now are no longer queued */
+    while (l->qcount > 0 && l->depart[l->qhead] <= time)
+    {
+        l->qbytes -= l->size[l->qhead];
+        l->qhead = (l->qhead + 1) % l->qcap;
+        l->qcount--;
+    }
+    occupancy = l->limit_bytes ? l->qbytes : l->qcount;
+    if (occupancy > l->qmax)
+        l->qmax = occupancy;
+
+    if (l->limit > 0)
+    {
+        if (l->red)
+        {
+            float minth = l->limit / 4.0, maxth = 3 * l->limit / 4.0;
+            l->red_avg += RED_WEIGHT * (occupancy - l->red_avg);
+            if (l->red_avg >= maxth ||
+                (l->red_avg > minth &&
+                 jimsrand() < RED_MAXP * (l->red_avg - minth) / (maxth - minth)))
+            {
+                l->ndrop_red++;
+                if (TRACE > 0)
+                    printf("          TOLAYER3: packet dropped early by RED\n");
+                return -1;
+            }
+        }
+        if (occupancy + (l->limit_bytes ? bytes : 1) > l->limit)
+        {
+            l->ndrop_tail++;
+            if (TRACE > 0)
+                printf("          TOLAYER3: queue full, packet dropped\n");
+            return -1;
+        }
+    }
+
+    if (l->qcount == l->qcap)
+    { /* grow the ring, unrolling it so that the head is at 0 */
+        int cap = l->qcap ? 2 * l->qcap : 64;
+        float *depart = (float *)malloc(cap * sizeof(float));
+        int *size = (int *)malloc(cap * sizeof(int));
+        for (i = 0; i < l->qcount; i++)
+        {
+            depart[i] = l->depart[(l->qhead + i) % l->qcap];
+            size[i] = l->size[(l->qhead + i) % l->qcap];
+        }
+        free(l->depart);
+        free(l->size);
+        l->depart = depart;
+        l->size = size;
+        l->qhead = 0;
+        l->qcap = cap;
+    }
+
+    start = l->busy_until > time ? l->busy_until : time;
+    l->busy_until = start + bytes / l->rate;
+    i = (l->qhead + l->qcount) % l->qcap;
+    l->depart[i] = l->busy_until;
+    l->size[i] = bytes;
+    l->qcount++;
+    l->qbytes += bytes;
+
+    l->nsent++;
+    l->bytes_sent += bytes;
+    l->busy_time += bytes / l->rate;
+    l->sojourn_sum += l->busy_until - time;
+    l->qdelay_sum += start - time;
+    return l->busy_until;
+}
+
+/********************* TOPOLOGY *******************/
+
+/* index of the node with the given name, added if it is new */
+int topology_node(const char *name, const char *file, int line)
+{
+    int n;
+
+    for (n = 0; n < nnodes; n++)
+        if (strcmp(node_name[n], name) == 0)
+            return n;
+    if (nnodes == MAX_NODES || strlen(name) >= NODE_NAME)
+    {
+        fprintf(stderr, "%s:%d: too many nodes or name too long: %s\n", file, line, name);
+        exit(1);
+    }
+    strcpy(node_name[nnodes], name);
+    return nnodes++;
+}
+
+/* index of the hop from one node to another, -1 if they are not linked */
+int topology_hop(int from, int to)
+{
+    int h;
+
+    for (h = 0; h < nhops; h++)
+        if (hops[h].from == from && hops[h].to == to)
+            return h;
+    return -1;
+}
+
+void read_topology(const char *file)
+{
+    FILE *fp = fopen(file, "r");
+    char buf[256], word[4][NODE_NAME + 1], queue[32];
+    int line = 0, n, h, d, dest, head, tail;
+    int queue_of[MAX_NODES], dist[MAX_NODES];
+    float rate, delay, loss;
+
+    if (fp == NULL)
+    {
+        perror(file);
+        exit(1);
+    }
+    strcpy(node_name[A], "A"); /* the nodes of the entities come first */
+    strcpy(node_name[B], "B");
+    nnodes = 2;
+    for (n = 0; n < MAX_NODES; n++)
+        route[n][A] = route[n][B] = -1;
+
+    while (fgets(buf, sizeof(buf), fp) != NULL)
+    {
+        line++;
+        if (sscanf(buf, "%16s", word[0]) != 1 || word[0][0] == '#')
+            continue;
+        if (strcmp(word[0], "link") == 0)
+        {
+            queue[0] = '\0';
+            loss = 0;
+            if (sscanf(buf, "%*s %16s %16s %f %f %31s %f", word[1], word[2], &rate, &delay,
+                       queue, &loss) < 4 || rate < 0 || delay < 0 || loss < 0 || loss > 1)
+            {
+                fprintf(stderr, "%s:%d: expected link node node rate delay [queue[b] [loss]]\n",
+                        file, line);
+                exit(1);
+            }
+            hops = (struct hop *)realloc(hops, (nhops + 2) * sizeof(struct hop));
+            for (d = 0; d < 2; d++)
+            {
+                struct hop *hp = &hops[nhops++];
+                memset(hp, 0, sizeof(*hp));
+                hp->from = topology_node(word[1 + d], file, line);
+                hp->to = topology_node(word[2 - d], file, line);
+                hp->q.rate = rate;
+                hp->q.delay = delay;
+                hp->q.limit = links[A].limit;
+                hp->q.limit_bytes = links[A].limit_bytes;
+                hp->q.red = links[A].red;
+                if (queue[0] != '\0')
+                {
+                    hp->q.limit = atoi(queue);
+                    hp->q.limit_bytes = queue[strlen(queue) - 1] == 'b';
+                }
+                hp->loss = loss;
+            }
+            if (hops[nhops - 1].from == hops[nhops - 1].to)
+            {
+                fprintf(stderr, "%s:%d: a link needs two different nodes\n", file, line);
+                exit(1);
+            }
+        }
+        else if (strcmp(word[0], "route") == 0)
+        {
+            if (sscanf(buf, "%*s %16s %16s %16s", word[1], word[2], word[3]) != 3 ||
+                (strcmp(word[2], "A") != 0 && strcmp(word[2], "B") != 0))
+            {
+                fprintf(stderr, "%s:%d: expected route node A|B next_node\n", file, line);
+                exit(1);
+            }
+            n = topology_node(word[1], file, line);
+            h = topology_hop(n, topology_node(word[3], file, line));
+            if (h < 0)
+            {
+                fprintf(stderr, "%s:%d: no link from %s to %s\n", file, line, word[1], word[3]);
+                exit(1);
+            }
+            route[n][word[2][0] == 'B'] = h;
+        }
+        else
+        {
+            fprintf(stderr, "%s:%d: unknown keyword %s\n", file, line, word[0]);
+            exit(1);
+        }
+    }
+    fclose(fp);
+
+    /* routes that were not given: breadth first search back from the */
+    /* destination, every node goes to a neighbour one hop closer     */
+    for (dest = A; dest <= B; dest++)
+    {
+        for (n = 0; n < nnodes; n++)
+            dist[n] = -1;
+        dist[dest] = 0;
+        queue_of[0] = dest;
+        for (head = 0, tail = 1; head < tail; head++)
+            for (h = 0; h < nhops; h++)
+                if (hops[h].to == queue_of[head] && dist[hops[h].from] < 0)
+                {
+                    dist[hops[h].from] = dist[queue_of[head]] + 1;
+                    queue_of[tail++] = hops[h].from;
+                    if (route[hops[h].from][dest] < 0)
+                        route[hops[h].from][dest] = h;
+                }
+
+        /* the path from the other end must reach dest without a loop */
+        for (n = !dest, d = 0; n != dest; n = hops[route[n][dest]].to, d++)
+            if (route[n][dest] < 0 || d == nnodes)
+            {
+                fprintf(stderr, "%s: no route from %s to %s\n", file, node_name[!dest], node_name[dest]);
+                exit(1);
+            }
+    }
+}
+
+/* put the packet of evptr on the next hop from node towards its         */
+/* destination; the event is reused for its arrival at the next node, or */
+/* freed together with the packet if the hop loses or drops it           */
+void hop_send(struct event *evptr, int node)
+{
+    int dest = evptr->eventity & 1; /* the node of entity id is id & 1 */
+    struct hop *hp = &hops[route[node][dest]];
+    int length = evptr->pktptr->length;
+    float departure = time;
+
+    if (length < 0 || length > MAX_PAYLOAD) /* the length field itself may be corrupted */
+        length = MAX_PAYLOAD;
+    hp->npkts++;
+    crn_key(CRN_HOP, route[node][dest], hp->npkts);
+    if (hp->q.rate > 0)
+        departure = link_enqueue(&hp->q, PKT_HEADER_SIZE + length);
+    if (departure < 0 || (hp->loss > 0 && jimsrand() < hp->loss))
+    {
+        if (departure >= 0)
+            hp->nlost++;
+        if (TRACE > 0)
+            printf("          TOPOLOGY: packet lost between %s and %s\n",
+                   node_name[hp->from], node_name[hp->to]);
+        free(evptr->pktptr);
+        free(evptr);
+        return;
+    }
+
+    evptr->evtime = departure + hp->q.delay;
+    evptr->evnode = hp->to;
+    evptr->evtype = hp->to == dest ? FROM_LAYER3 : FROM_ROUTER;
+    if (TRACE > 2)
+        printf("          TOPOLOGY: %s -> %s, arrives at %f\n", node_name[hp->from],
+               node_name[hp->to], evptr->evtime);
+    schedule(evptr);
+}
+
+/* per hop counters, then the path in each direction with the queueing */
+/* delay and propagation delay added up over its hops                   */
+void print_topology_stats()
+{
+    int h, n, dest;
+    struct hop *hp;
+    double qdelay, delay;
+
+    for (h = 0; h < nhops; h++)
+    {
+        hp = &hops[h];
+        if (hp->npkts == 0)
+            continue;
+        if (hp->q.rate > 0)
+            print_link_stats(&hp->q, node_name[hp->from], node_name[hp->to]);
+        else
+            printf(" link %s->%s: pkts: %d\n", node_name[hp->from], node_name[hp->to], hp->npkts);
+        if (hp->loss > 0)
+            printf("   lost on the wire: %d (%.1f%%)\n", hp->nlost, 100.0 * hp->nlost / hp->npkts);
+    }
+    for (dest = B; dest >= A; dest--)
+    {
+        qdelay = delay = 0;
+        printf(" path %s->%s: %s", node_name[!dest], node_name[dest], node_name[!dest]);
+        for (n = !dest; n != dest; n = hp->to)
+        {
+            hp = &hops[route[n][dest]];
+            delay += hp->q.delay;
+            if (hp->q.nsent > 0)
+                qdelay += hp->q.qdelay_sum / hp->q.nsent;
+            printf(" %s", node_name[hp->to]);
+        }
+        printf(", propagation delay: %f, mean queueing delay: %f\n", delay, qdelay);
+    }
+}
+
+/********************* PARALLEL SIMULATION *******************/
+
+/* -P threads runs the simulation as a conservative parallel discrete  */
+/* event simulation.  The logical processes are                          */
+/*   - the flow processes: flow f (entities 2f and 2f+1) belongs to      */
+/*     process f % threads, which has the event list of its flows,       */
+/*   - the network processes: one per side (links[s] and channels[s]),   */
+/*     or with -t one per hop; the first hop of a side also does for     */
+/*     that side what network_send() does without a topology.           */
+/* Flows only meet in the network, and whatever the network sends       */
+/* arrives at least the lookahead after it was sent: the smallest        */
+/* propagation delay, or the 1 time unit minimum of the original         */
+/* channel.  Simulated time is cut into windows of half the lookahead    */
+/* (YAWNS; half, so that float rounding of arrival times cannot reach    */
+/* back into the window).  In each window the flow processes run first,  */
+/* then the network processes take what the flows handed to layer 3 in   */
+/* the window; what the network sends lands in a later window.  The      */
+/* threads meet at a barrier between these steps, and the next window    */
+/* starts at the earliest pending event.                                 */
+/* Every flow and network process draws from its own random number      */
+/* stream (seeded by -s), events go by (time, sender, number of events  */
+/* the sender scheduled before) whichever list they are on, and each     */
+/* flow generates its share of the messages.  -s without -P runs the     */
+/* same processes on one event list and stops where -P would, at the     */
+/* start of the first window after the last flow is done, so the output  */
+/* with -s is the same byte for byte whether or not -P is given, and     */
+/* for any number of threads: make pdescheck compares them.  Without -s  */
+/* and -P the run takes every random number from one rand() sequence in  */
+/* the global event order, as the original emulator did.                 */
+struct mailbox
+{
+    struct event **ev;
+    int n, cap;
+};
+
+struct lproc
+{
+    struct evlist list;
+    int nactive;            /* flow processes: flows still generating messages */
+    float last_time;        /* time of the last event carried out */
+    long nevents_done[NEVTYPES];
+};
+
+int nprocs;                 /* nthreads flow processes, then the network processes */
+struct lproc *procs;
+struct mailbox *outbox;     /* outbox[src * nprocs + dst] */
+int nnet;                   /* network processes: 2, or one per hop with -t */
+unsigned long long *net_rng; /* their random number streams */
+unsigned long *net_posted;  /* and the events they scheduled */
+int nflows_active;          /* -s without -P: flows still generating messages */
+double lookahead;
+long nwindows;
+struct pdes_slot
+{
+    double next;            /* earliest pending event of the thread's processes */
+    int nactive;
+#if PROFILE
+    struct prof prof;       /* what the thread profiled, added up at the end */
+#endif
+} *pdes_slots;
+
+__thread int cur_proc;                /* process whose event is being carried out */
+__thread int cur_src;                 /* and the sender id it gives to what it schedules */
+__thread unsigned long *cur_seq;
+__thread unsigned long long *cur_rng; /* stream of jimsrand(), NULL = rand() */
+__thread double window_end;
+
+/* splitmix64 */
+unsigned long long stream_next(unsigned long long *s)
+{
+    unsigned long long z = (*s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+unsigned long long stream_seed(int id)
+{
+    unsigned long long s = seed * 0x2545F4914F6CDD1DULL + id;
+    return stream_next(&s);
+}
+
+/* the network process that carries out an event, -1 for a flow event */
+int net_proc_of(struct event *p)
+{
+    int from;
+
+    if (p->evtype == TO_LAYER3)
+    {
+        from = (p->eventity ^ 1) & 1;
+        return nnodes > 0 ? route[from][!from] : from;
+    }
+    if (p->evtype == FROM_ROUTER)
+        return route[p->evnode][p->eventity & 1];
+    return -1;
+}
+
+/* the process that carries out an event */
+int pdes_proc_of(struct event *p)
+{
+    int k = net_proc_of(p);
+
+    return k >= 0 ? nthreads + k : p->eventity / 2 % nthreads;
+}
+
+/* put an event on the event list of the process that carries it out; */
+/* events for other processes wait in the outbox until the next merge  */
+void schedule(struct event *p)
+{
+    int dst;
+    struct mailbox *m;
+
+    if (lpmode)
+    {
+        p->evsrc = cur_src;
+        p->evseq = (*cur_seq)++;
+    }
+    if (nthreads == 0 || (dst = pdes_proc_of(p)) == cur_proc)
+    {
+        insertevent(p);
+        return;
+    }
+    if (p->evtype != TO_LAYER3 && p->evtime < window_end)
+    {
+        printf("INTERNAL PANIC: event at %f sent into the window ending at %f\n",
+               p->evtime, window_end);
+        exit(1);
+    }
+    m = &outbox[cur_proc * nprocs + dst];
+    if (m->n == m->cap)
+    {
+        m->cap = m->cap ? 2 * m->cap : 16;
+        m->ev = (struct event **)realloc(m->ev, m->cap * sizeof(struct event *));
+    }
+    m->ev[m->n++] = p;
+}
+
+/* move what processes from .. to-1 sent to process p onto its list; */
+/* where they go on it depends on the events alone, see evbefore()   */
+void pdes_merge(int p, int from, int to)
+{
+    struct mailbox *m;
+    int src, i;
+
+    evlist = &procs[p].list;
+    for (src = from; src < to; src++)
+    {
+        m = &outbox[src * nprocs + p];
+        for (i = 0; i < m->n; i++)
+            insertevent(m->ev[i]);
+        m->n = 0;
+    }
+}
+
+int flow_quota(int flow)
+{
+    return nsimmax / nflows + (flow < nsimmax % nflows);
+}
+
+/* the count of active flows that flow is in */
+int *nactive_of(int flow)
+{
+    return nthreads > 0 ? &procs[flow % nthreads].nactive : &nflows_active;
+}
+
+/* a saturated flow has generated its quota, see layer5_pull(); with -F */
+/* it stays active until it has completed                             */
+void pdes_flow_done(int flow)
+{
+    if (!drain)
+        (*nactive_of(flow))--;
+}
+
+/* carry out what follows on behalf of entity id, outside of an event */
+void lp_enter(int id)
+{
+    if (nthreads > 0)
+    {
+        cur_proc = id / 2 % nthreads;
+        evlist = &procs[cur_proc].list;
+    }
+    cur_src = id;
+    cur_seq = &endpoints[id].nposted;
+    cur_rng = &endpoints[id & ~1].rng;
+}
+
+/* the network processes and the lookahead, from init() */
+void lp_setup()
+{
+    int i;
+
+    nnet = nnodes > 0 ? nhops : 2;
+    net_rng = (unsigned long long *)calloc(nnet, sizeof(unsigned long long));
+    net_posted = (unsigned long *)calloc(nnet, sizeof(unsigned long));
+    if (nnodes > 0)
+    {
+        lookahead = hops[0].q.delay;
+        for (i = 1; i < nhops; i++)
+            if (hops[i].q.delay < lookahead)
+                lookahead = hops[i].q.delay;
+    }
+    else
+        lookahead = links[A].rate > 0 ? links[A].delay : 1.0;
+}
+
+/* seed the streams, then the first arrival of every flow that has */
+/* messages to send and the entities, each on behalf of itself      */
+void lp_start()
+{
+    int i;
+
+    for (i = 0; i < nnet; i++)
+        net_rng[i] = stream_seed(nflows + i);
+    for (i = 0; i < nflows; i++)
+    {
+        endpoints[2 * i].rng = stream_seed(i);
+        if (flow_quota(i) == 0)
+            continue;
+        lp_enter(2 * i);
+        if (!saturated)
+            generate_next_arrival(i);
+        (*nactive_of(i))++;
+    }
+    for (i = 0; i < nentities; i++)
+    {
+        lp_enter(i);
+        entity_init(i);
+    }
+    for (i = 0; i < nentities; i++)
+    {
+        lp_enter(i);
+        layer5_pull(i); /* -S: the first messages */
+    }
+}
+
+/* carry out an event in its logical process and count it in ndone */
+void lp_dispatch(struct event *eventptr, long *ndone)
+{
+    int f = eventptr->eventity / 2, k = net_proc_of(eventptr);
+
+    if (k >= 0)
+    {
+        cur_src = nentities + k;
+        cur_seq = &net_posted[k];
+        cur_rng = &net_rng[k];
+        ndone[eventptr->evtype]++;
+        PROF_CALL(eventptr->evtype, dispatch(eventptr));
+        return;
+    }
+    cur_src = eventptr->eventity;
+    cur_seq = &endpoints[eventptr->eventity].nposted;
+    cur_rng = &endpoints[2 * f].rng;
+    if (eventptr->evtype == FROM_LAYER5 && layer5_done(2 * f))
+    { /* this flow is done, or with -F it drains from now on */
+        if (!drain)
+            (*nactive_of(f))--;
+        free(eventptr);
+        return;
+    }
+    ndone[eventptr->evtype]++;
+    PROF_CALL(eventptr->evtype, dispatch(eventptr));
+    if (drain && layer5_done(2 * f) && flow_check(f))
+        (*nactive_of(f))--;
+}
+
+/* run process p up to the end of the window */
+void pdes_process(int p)
+{
+    struct lproc *lp = &procs[p];
+    struct event *eventptr;
+
+    cur_proc = p;
+    evlist = &lp->list;
+    prof_loop_start();
+    while (evlist->nevents > 0 && evlist->heap[0]->evtime < window_end)
+    {
+        eventptr = evlist->heap[0];
+        prof_event(eventptr);
+        removeevent(eventptr);
+        if (TRACE >= 2)
+            PROF_CALL(PROF_TRACE, trace_event(eventptr));
+        time = lp->last_time = eventptr->evtime;
+        lp_dispatch(eventptr, lp->nevents_done);
+    }
+    prof_loop_stop();
+}
+
+void *pdes_worker(void *arg)
+{
+    int t = (int)(long)arg, p, i, nactive;
+    double next;
+
+    while (1)
+    {
+        /* what the network processes sent in the last window */
+        for (p = t; p < nprocs; p += nthreads)
+            pdes_merge(p, nthreads, nprocs);
+        pdes_slots[t].next = HUGE_VAL;
+        pdes_slots[t].nactive = procs[t].nactive;
+        for (p = t; p < nprocs; p += nthreads)
+            if (procs[p].list.nevents > 0 && procs[p].list.heap[0]->evtime < pdes_slots[t].next)
+                pdes_slots[t].next = procs[p].list.heap[0]->evtime;
+        threads_barrier_wait();
+
+        /* every thread works out the same next window */
+        next = HUGE_VAL;
+        nactive = 0;
+        for (i = 0; i < nthreads; i++)
+        {
+            if (pdes_slots[i].next < next)
+                next = pdes_slots[i].next;
+            nactive += pdes_slots[i].nactive;
+        }
+        if (nactive == 0 || next == HUGE_VAL)
+            break;
+        window_end = next + lookahead / 2;
+        if (t == 0)
+            nwindows++;
+
+        pdes_process(t); /* the flows */
+        threads_barrier_wait();
+        for (p = nthreads + t; p < nprocs; p += nthreads)
+        {
+            pdes_merge(p, 0, nthreads); /* what the flows handed to layer 3 */
+            pdes_process(p);
+        }
+        threads_barrier_wait();
+    }
+#if PROFILE
+    pdes_slots[t].prof = prof;
+#endif
+    return NULL;
+}
+
+void pdes_run()
+{
+    int i, p;
+
+    if (lookahead <= 0)
+    {
+        fprintf(stderr, "-P needs a propagation delay greater than 0\n");
+        exit(1);
+    }
+
+    nprocs = nthreads + nnet;
+    procs = (struct lproc *)calloc(nprocs, sizeof(struct lproc));
+    outbox = (struct mailbox *)calloc(nprocs * nprocs, sizeof(struct mailbox));
+    pdes_slots = (struct pdes_slot *)calloc(nthreads, sizeof(struct pdes_slot));
+    lp_start();
+    for (p = nthreads; p < nprocs; p++)
+        pdes_merge(p, 0, nthreads); /* what the entities handed to layer 3 */
+
+    threads_barrier_init(nthreads);
+    threads_run(nthreads, pdes_worker);
+
+    time = 0;
+    for (p = 0; p < nprocs; p++)
+        if (procs[p].last_time > time)
+            time = procs[p].last_time;
+    for (i = 0; i < nentities; i++)
+        nsim += endpoints[i].ngenerated;
+    for (p = 0; p < nprocs; p++)
+        for (i = 0; i < NEVTYPES; i++)
+            nevents_done[i] += procs[p].nevents_done[i];
+#if PROFILE
+    memset(&prof, 0, sizeof(prof)); /* thread 0 was this one */
+    for (i = 0; i < nthreads; i++)
+        prof_merge(&prof, &pdes_slots[i].prof);
+#endif
+    if (drain)
+        for (p = 0; p < nprocs; p++)
+            free_events(&procs[p].list);
+}
+
+/* after the statistics, so that they read the same with and without -P */
+void pdes_report()
+{
+    printf(" parallel: %d logical processes, lookahead %f, %ld windows\n", nflows + nnet,
+           lookahead, nwindows);
+}
+
+/********************** Student-callable ROUTINES ***********************/
+
+/* called by students routine to cancel a previously-started timer */
+void stoptimer(int AorB) /* A or B is trying to stop timer */
+{
+    struct event *q = endpoints[AorB].timer;
+
+    if (TRACE > 2)
+        printf("          STOP TIMER: stopping timer at %f\n", time);
+    if (q == NULL)
+    {
+        printf("Warning: unable to cancel your timer. It wasn't running.\n");
+        return;
+    }
+    removeevent(q);
+    free(q);
+    endpoints[AorB].timer = NULL;
+}
+
+void starttimer(int AorB, float increment) /* A or B is trying to stop timer */
+{
+    struct event *evptr;
+    /* char *malloc(); // malloc redefinition removed */
+
+    if (TRACE > 2)
+        printf("          START TIMER: starting timer at %f\n", time);
+    /* be nice: check to see if timer is already started, if so, then  warn */
+    if (endpoints[AorB].timer != NULL)
+    {
+        printf("Warning: attempt to start a timer that is already started\n");
+        return;
+    }
+
+    /* create future event for when timer goes off */
+    evptr = (struct event *)malloc(sizeof(struct event));
+    evptr->evtime = (float)(time + increment);
+    evptr->evtype = TIMER_INTERRUPT;
+    evptr->eventity = AorB;
+    evptr->pktptr = NULL;
+    endpoints[AorB].timer = evptr;
+    schedule(evptr);
+}
+
+/* name of an entity in traces: A and B, or A7 and B7 for flow 7 when */
+/* there are several flows                                            */
+const char *entity_name(int id)
+{
+    static __thread char names[4][16];
+    static __thread int next;
+    char *name = names[next++ % 4];
+
+    if (nflows == 1)
+        sprintf(name, "%c", 'A' + (id & 1));
+    else
+        sprintf(name, "%c%d", 'A' + (id & 1), id / 2);
+    return name;
+}
+
+/* protocol event log, only printed with TRACE > 0 */
+void trace_printf(const char *format, ...)
+{
+    va_list args;
+
+    if (TRACE <= 0)
+        return;
+    PROF_BEGIN();
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    PROF_END(PROF_TRACE);
+}
+
+/************************** TOLAYER3 ***************/
+void tolayer3(int AorB, struct pkt packet) /* A or B is trying to stop timer */
+{
+    struct event *evptr;
+    /* char *malloc(); // malloc redefinition removed */
+    PROF_BEGIN();
+
+    /* make a copy of the packet student just gave me since he/she may decide */
+    /* to do something with the packet after we return back to him/her */
+    evptr = (struct event *)malloc(sizeof(struct event));
+    evptr->pktptr = (struct pkt *)malloc(sizeof(struct pkt));
+    *evptr->pktptr = packet;
+    evptr->eventity = AorB ^ 1; /* event occurs at other entity */
+    evptr->evtime = time;
+
+    /* with -s or -P the network of this side runs in its own logical process */
+    if (lpmode)
+    {
+        evptr->evtype = TO_LAYER3;
+        schedule(evptr);
+    }
+    else
+        network_send(evptr);
+    PROF_END(PROF_TOLAYER3);
+}
+
+/* the network side of tolayer3: the packet of evptr was sent to */
+/* evptr->eventity at time evptr->evtime                         */
+void network_send(struct event *evptr)
+{
+    struct pkt *mypktptr = evptr->pktptr;
+    int from = (evptr->eventity ^ 1) & 1; /* side that sent the packet */
+    struct traffic *tr = &traffic[from];
+    float lastime, departure = 0, x, jimsrand();
+    int i;
+
+    tr->ntolayer3++;
+    tr->nbytes_header += PKT_HEADER_SIZE;
+    tr->nbytes_payload += mypktptr->length;
+
+    /* with the link model, the packet first has to get into the queue */
+    if (links[from].rate > 0)
+    {
+        crn_key(CRN_QUEUE, from, tr->ntolayer3);
+        departure = link_enqueue(&links[from], PKT_HEADER_SIZE + mypktptr->length);
+        if (departure < 0)
+        {
+            free(mypktptr);
+            free(evptr);
+            return;
+        }
+    }
+
+    /* simulate losses: */
+    crn_key(CRN_LOSS, from, tr->ntolayer3);
+    if (channel_lost(from))
+    {
+        tr->nlost++;
+        if (TRACE > 0)
+            printf("          TOLAYER3: packet being lost\n");
+        free(mypktptr);
+        free(evptr);
+        return;
+    }
+
+    if (TRACE > 2)
+    {
+        printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
+               mypktptr->acknum, mypktptr->checksum);
+        for (i = 0; i < mypktptr->length && i < MAX_PAYLOAD; i++)
+            printf("%c", mypktptr->payload[i]);
+        printf("\n");
+    }
+
+    /* create future event for arrival of packet at the other side */
+    evptr->evtype = FROM_LAYER3;      /* packet will pop out from layer3 */
+                                      /* finally, compute the arrival time of packet at the other end.
+                                         medium can not reorder, so make sure packet arrives between 1 and 10
+                                         time units after the latest arrival time of packets
+                                         currently in the medium on their way to the destination */
+    crn_key(CRN_DELAY, from, tr->ntolayer3);
+    if (nnodes > 0)
+        evptr->evtime = time; /* hop_send works out the arrival at the first node */
+    else if (links[from].rate > 0)
+        evptr->evtime = departure + links[from].delay; /* FIFO link: still in order */
+    else
+    {
+        /* last_arrival is what scanning the event list for the last */
+        /* packet in flight to the same entity used to find          */
+        lastime = endpoints[evptr->eventity].last_arrival;
+        if (lastime < time)
+            lastime = time;
+        evptr->evtime = lastime + 1 + 9 * jimsrand();
+    }
+    if (reorder_prob > 0 && jimsrand() < reorder_prob)
+    {
+        tr->nreordered++;
+        evptr->evtime += reorder_depth * jimsrand();
+        if (TRACE > 0)
+            printf("          TOLAYER3: packet held back, may be overtaken\n");
+    }
+    else
+        endpoints[evptr->eventity].last_arrival = evptr->evtime;
+
+    /* simulate corruption: */
+    crn_key(CRN_CORRUPT, from, tr->ntolayer3);
+    if (ber > 0)
+    {
+        if (channel_flip_bits(from, mypktptr, PKT_HEADER_SIZE + mypktptr->length) > 0)
+        {
+            tr->ncorrupt++;
+            if (TRACE > 0)
+                printf("          TOLAYER3: bits flipped in packet\n");
+        }
+    }
+    else if (jimsrand() < corruptprob)
+    {
+        tr->ncorrupt++;
+        if ((x = jimsrand()) < .75)
+            mypktptr->payload[0] = 'Z'; /* corrupt payload */
+        else if (x < .875)
+            mypktptr->seqnum = 999999;
+        else
+            mypktptr->acknum = 999999;
+        if (TRACE > 0)
+            printf("          TOLAYER3: packet being corrupted\n");
+    }
+
+    crn_key(CRN_DUP, from, tr->ntolayer3);
+    if (dup_prob > 0 && jimsrand() < dup_prob)
+    {
+        struct event *dup = (struct event *)malloc(sizeof(struct event));
+        *dup = *evptr;
+        dup->pktptr = (struct pkt *)malloc(sizeof(struct pkt));
+        *dup->pktptr = *mypktptr;
+        dup->evtime = evptr->evtime + 1 + 9 * jimsrand();
+        tr->nduplicated++;
+        if (TRACE > 0)
+            printf("          TOLAYER3: packet duplicated\n");
+        schedule(dup);
+    }
+
+    if (TRACE > 2)
+        printf("          TOLAYER3: scheduling arrival on other side\n");
+    if (nnodes > 0)
+        hop_send(evptr, from); /* the node of A is 0, the node of B is 1 */
+    else
+        schedule(evptr);
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+    int i;
+    struct endpoint *to = &endpoints[AorB], *from = &endpoints[AorB ^ 1];
+    float delay;
+    PROF_BEGIN();
+
+    /* a protocol that delivers more than was generated is broken, */
+    /* but don't let it take the statistics down with it          */
+    while (to->nmatched < from->ngenerated && from->genletter[to->nmatched] == 0)
+        to->nmatched++; /* dropped, it will not come */
+    if (to->nmatched < from->ngenerated)
+    {
+        delay = time - from->gentime[to->nmatched];
+        if (datasent[0] != from->genletter[to->nmatched++])
+            to->nmisdelivered++;
+        to->latency_sum += delay;
+        if (delay > to->latency_max)
+            to->latency_max = delay;
+        if (steady.target > 0)
+            steady_observe(delay);
+    }
+    to->ndelivered++;
+    to->last_delivery = time;
+    if (TRACE > 2)
+    {
+        printf("          TOLAYER5: data received: ");
+        for (i = 0; i < 20; i++)
+            printf("%c", datasent[i]);
+        printf("\n");
+    }
+    PROF_END(PROF_TOLAYER5);
+}
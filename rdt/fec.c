@@ -0,0 +1,139 @@
+#include <string.h>
+
+#include "fec.h"
+
+void fec_encoder_init(struct fec_encoder *f, int k_max) {
+    memset(f, 0, sizeof(*f));
+    if (k_max > FEC_K_MAX) {
+        k_max = FEC_K_MAX;
+    }
+    if (k_max < FEC_K_MIN) {
+        k_max = FEC_K_MIN;
+    }
+    f->k_max = k_max;
+    f->k = k_max;
+}
+
+/* 根据接收方报告的丢失率选择 k，使每组平均丢失约半个分组 */
+void fec_set_loss(struct fec_encoder *f, float loss) {
+    if (loss <= 0.5 / f->k_max) {
+        f->k = f->k_max;
+    } else if (loss >= 0.5 / FEC_K_MIN) {
+        f->k = FEC_K_MIN;
+    } else {
+        f->k = (int)(0.5 / loss);
+    }
+}
+
+/* 把一个新发出的帧加入当前组；组满时填好校验帧并返回 1 */
+int fec_add(struct fec_encoder *f, int seq, struct pkt *frame, struct pkt *parity) {
+    if (f->count == 0) {
+        f->first = seq;
+        f->group_k = f->k;
+        f->xorlen = 0;
+        f->maxlen = 0;
+        memset(f->xorbuf, 0, sizeof(f->xorbuf));
+    }
+
+    for (int i = 0; i < frame->length; i++) {
+        f->xorbuf[i] ^= frame->payload[i];
+    }
+    f->xorlen ^= frame->length;
+    if (frame->length > f->maxlen) {
+        f->maxlen = frame->length;
+    }
+    f->count++;
+
+    if (f->count < f->group_k) {
+        return 0;
+    }
+
+    parity->seqnum = FEC_PARITY;
+    parity->length = FEC_HEADER + f->maxlen;
+    memcpy(parity->payload, &f->first, sizeof(int));
+    memcpy(parity->payload + 4, &f->count, sizeof(int));
+    memcpy(parity->payload + 8, &f->xorlen, sizeof(int));
+    memcpy(parity->payload + FEC_HEADER, f->xorbuf, f->maxlen);
+    f->count = 0;
+    f->nparity++;
+    return 1;
+}
+
+void fec_decoder_init(struct fec_decoder *d) {
+    memset(d, 0, sizeof(*d));
+    for (int i = 0; i < FEC_HISTORY; i++) {
+        d->hist_seq[i] = -1;
+    }
+    d->highest = -1;
+}
+
+static void save_frame(struct fec_decoder *d, int seq, struct pkt *frame) {
+    d->hist[seq % FEC_HISTORY] = *frame;
+    d->hist_seq[seq % FEC_HISTORY] = seq;
+}
+
+/* 保存一个收到的帧（按绝对序号）；比此前收到的都新的帧是首次传输，
+   它和中间跳过的帧更新丢失率估计，跳过太多时按 FEC_HISTORY 个算，估计早已饱和 */
+void fec_store(struct fec_decoder *d, int seq, struct pkt *frame) {
+    if (seq < 0) {
+        return;
+    }
+    if (seq > d->highest) {
+        int gap = seq - d->highest - 1;
+        if (gap > FEC_HISTORY) {
+            gap = FEC_HISTORY;
+        }
+        for (int i = 0; i < gap; i++) {
+            d->loss_est += FEC_LOSS_GAIN * (1 - d->loss_est);
+        }
+        d->loss_est -= FEC_LOSS_GAIN * d->loss_est;
+        d->highest = seq;
+    }
+    save_frame(d, seq, frame);
+}
+
+struct pkt *fec_lookup(struct fec_decoder *d, int seq) {
+    if (seq < 0 || d->hist_seq[seq % FEC_HISTORY] != seq) {
+        return NULL;
+    }
+    return &d->hist[seq % FEC_HISTORY];
+}
+
+/* 校验帧到达：组内恰好缺一帧时把它还原到 *out，返回其绝对序号，否则返回 -1 */
+int fec_recover(struct fec_decoder *d, struct pkt *parity, struct pkt *out) {
+    int first, count, len, maxlen = parity->length - FEC_HEADER;
+    int missing = -1, nmissing = 0;
+
+    if (maxlen < 0 || maxlen > MAX_MSS) {
+        return -1;
+    }
+    memcpy(&first, parity->payload, sizeof(int));
+    memcpy(&count, parity->payload + 4, sizeof(int));
+    memcpy(&len, parity->payload + 8, sizeof(int));
+    if (first < 0 || count < 1 || count > FEC_K_MAX) {
+        return -1;
+    }
+
+    memcpy(out->payload, parity->payload + FEC_HEADER, maxlen);
+    memset(out->payload + maxlen, 0, MAX_PAYLOAD - maxlen);
+    for (int seq = first; seq < first + count; seq++) {
+        struct pkt *frame = fec_lookup(d, seq);
+        if (frame == NULL) {
+            missing = seq;
+            nmissing++;
+            continue;
+        }
+        for (int i = 0; i < frame->length; i++) {
+            out->payload[i] ^= frame->payload[i];
+        }
+        len ^= frame->length;
+    }
+
+    if (nmissing != 1 || len < 0 || len > maxlen) {
+        return -1;
+    }
+    out->length = len;
+    save_frame(d, missing, out);
+    d->nrecovered++;
+    return missing;
+}
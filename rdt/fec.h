@@ -0,0 +1,61 @@
+#ifndef FEC_H
+#define FEC_H
+
+#include "rdt.h"
+
+/**
+ * XOR 奇偶校验前向纠错，供 gbn.c 和 sr.c 共用。
+ *
+ * 发送方每发出 k 个新帧就发一个校验帧，校验帧的载荷为
+ *   [第一帧的绝对序号][帧数][各帧长度的异或][各帧载荷的异或]
+ * 接收方保存最近收到的帧，校验帧到达时若该组恰好缺一帧，
+ * 就用校验帧异或其余各帧把它还原出来，不需要重传。
+ *
+ * k 随接收方观察到的丢失率调整，接收方把估计值放在单独ACK的载荷里带回。
+ * 估计值取自首次传输的空洞：比此前最高序号还新的帧到达时，中间跳过的帧记为丢失，
+ * 该帧记为到达；重传和还原出的帧不参与，否则估计的只是重传之后残余的丢失。
+ *
+ * 校验帧要等组内 k 帧都发出才能发。一帧丢失后它占住发送窗口，之后最多还能发
+ * 窗口大小减一个帧，组再大就要等重传修好这一帧才凑得齐，FEC 也就没用了，
+ * 所以 k 不超过窗口大小减一，由协议在 fec_encoder_init 时给出。
+ */
+
+#define FEC_PARITY -2      /* seqnum 为 FEC_PARITY 的分组是校验帧 */
+#define FEC_HEADER 12      /* 校验帧载荷前的三个 int */
+#define FEC_K_MIN 2
+#define FEC_K_MAX 16       /* k 的绝对上限，实际上限见 fec_encoder.k_max */
+#define FEC_HISTORY 64     /* 接收方保存的最近帧数，至少是 FEC_K_MAX 的两倍 */
+#define FEC_LOSS_GAIN 0.02 /* 丢失率估计的 EWMA 系数，每个首次传输的帧更新一次 */
+
+/* 发送方：当前组的异或累加 */
+struct fec_encoder {
+    int k;          /* 每组的数据帧数 */
+    int k_max;      /* k 的上限，发送窗口大小减一 */
+    int first;      /* 当前组第一帧的绝对序号 */
+    int count;      /* 当前组已累加的帧数 */
+    int group_k;    /* 当前组开始时的 k，组内不变 */
+    int xorlen;
+    int maxlen;
+    char xorbuf[MAX_MSS];
+    int nparity;    /* 发出的校验帧数 */
+};
+
+/* 接收方：最近收到的帧和丢失率估计 */
+struct fec_decoder {
+    struct pkt hist[FEC_HISTORY];
+    int hist_seq[FEC_HISTORY]; /* 该位置保存的帧的绝对序号，-1 表示空 */
+    int highest;               /* 收到过的最高绝对序号，-1 表示还没有 */
+    float loss_est;            /* 首次传输丢失率的 EWMA */
+    int nrecovered;            /* 不经重传还原出的帧数 */
+};
+
+void fec_encoder_init(struct fec_encoder *f, int k_max);
+int fec_add(struct fec_encoder *f, int seq, struct pkt *frame, struct pkt *parity);
+void fec_set_loss(struct fec_encoder *f, float loss);
+
+void fec_decoder_init(struct fec_decoder *d);
+void fec_store(struct fec_decoder *d, int seq, struct pkt *frame);
+struct pkt *fec_lookup(struct fec_decoder *d, int seq);
+int fec_recover(struct fec_decoder *d, struct pkt *parity, struct pkt *out);
+
+#endif
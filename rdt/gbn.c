@@ -1,638 +1,547 @@
-
 #include <stdio.h>
 #include <stdlib.h> /* for malloc, free, srand, rand */
 #include <string.h>
 
-/*******************************************************************
- ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
-
-   This code should be used for PA2, unidirectional or bidirectional
-   data transfer protocols (from A to B. Bidirectional transfer of data
-   is for extra credit and is not required).  Network properties:
-   - one way network delay averages five time units (longer if there
-     are other messages in the channel for GBN), but can be larger
-   - packets can be corrupted (either the header or the data portion)
-     or lost, according to user-defined probabilities
-   - packets will be delivered in the order in which they were sent
-     (although some can be lost).
-**********************************************************************/
-
-#define BIDIRECTIONAL 0 /* change to 1 if you're doing extra credit */
-                        /* and write a routine called B_output */
-
-/* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
-/* 4 (students' code).  It contains the data (characters) to be delivered */
-/* to layer 5 via the students transport level protocol entities.         */
-struct msg
-{
-    char data[20];
-};
+#include "rdt.h"
+#include "checksum.h"
+#include "fec.h"
+
+/**
+ * GBN（Go-Back-N）协议，A 和 B 都同时运行发送方和接收方（全双工）。
+ * 反方向有数据要发时，累计ACK搭载在数据分组的 acknum 上；
+ * 没有数据可搭载时，等待 ACK_HOLD 后再单独发送ACK。
+ *
+ * 模拟器只给每个实体一个定时器，重传、延迟ACK、周期累计ACK
+ * 三个逻辑定时器各自记录截止时间，实际定时器总是对准最早的那个。
+ * 累计ACK只在收到新数据之后重复一次，没有新数据时不再定期触发，
+ * 所以双方空闲时事件表里没有它们的定时器。
+ *
+ * 序号编号的是帧：一帧装入 mss/MSG_SIZE 条排队中的上层消息（-m，默认一条）。
+ * 按 Nagle 规则，不满的帧只在没有未确认数据时才发送，否则等ACK到来再组帧。
+ *
+ * 编译时 -DFEC=1 打开前向纠错（见 fec.h）：接收方保存乱序到达的帧，
+ * 用校验帧还原组内丢失的一帧后连同后面已到的帧一起交付。
+ */
+
+/********* STUDENTS WRITE THE NEXT SEVEN ROUTINES *********/
 
-/* a packet is the data unit passed from layer 4 (students code) to layer */
-/* 3 (teachers code).  Note the pre-defined packet structure, which all   */
-/* students must follow. */
-struct pkt
-{
-    int seqnum;
-    int acknum;
-    int checksum;
-    char payload[20];
+#ifndef WINDOW_SIZE
+#define WINDOW_SIZE 8     /* 编译时可用 -DWINDOW_SIZE=n 覆盖，tune.c 靠它搜索 */
+#endif
+#define MAX_SEQ 1024      /* 发送缓冲最多能容纳的消息数，序号本身不回绕 */
+#define BUFFER_INIT 16    /* 发送缓冲的初始大小，不够时加倍直到 MAX_SEQ */
+#ifndef TIMEOUT_INTERVAL
+#define TIMEOUT_INTERVAL 600.0 /* 同上，-DTIMEOUT_INTERVAL=t */
+#endif
+#define CUMULATIVE_ACK_INTERVAL 2000.0
+#define ACK_HOLD 5.0      /* 没有反向数据可搭载时，ACK最多等待的时间，约半个RTT */
+#define NO_DATA -1        /* seqnum 为 NO_DATA 的分组是单独的ACK */
+
+#ifndef PIGGYBACK
+#define PIGGYBACK 1 /* ACK搭载在反向数据上，编译时 -DPIGGYBACK=0 关闭以作对比 */
+#endif
+
+#ifndef NAGLE
+#define NAGLE 1 /* 有未确认数据时暂缓发送不满的帧，-DNAGLE=0 关闭 */
+#endif
+
+#ifndef FEC
+#define FEC 0 /* 每 k 个新帧发一个异或校验帧，-DFEC=1 打开 */
+#endif
+
+/* 每个实体的状态 */
+struct gbn_entity {
+    /* 发送方 */
+    struct msg *send_buffer; /* 上层消息的环形缓冲 */
+    int buffer_cap;     /* send_buffer 的大小 */
+    int msg_base;       /* 最早未确认的消息 */
+    int msg_next;       /* 下一条还没装进帧的消息 */
+    int buffer_end;     /* 已缓存的上层消息之后的第一条 */
+    int frame_first[WINDOW_SIZE]; /* 窗口内每一帧的第一条消息 */
+    int frame_count[WINDOW_SIZE]; /* 窗口内每一帧的消息条数 */
+    unsigned int frame_sum[WINDOW_SIZE]; /* 每一帧载荷的校验和中间值，重传时只补头部 */
+    int send_base;      /* 发送窗口基序号 */
+    int next_seq;       /* 下一个要发送的序号 */
+
+    /* 接收方 */
+    int expected_seq;   /* 接收方期望的序列号 */
+    int ack_pending;    /* 有还没发出去的ACK */
+
+    /* 前向纠错 */
+    struct fec_encoder *fec_tx; /* 只在 FEC 打开时分配 */
+    struct fec_decoder *fec_rx;
+
+    /* 逻辑定时器的截止时间，<0 表示未启动 */
+    float rto_deadline;
+    float ack_deadline;
+    float cumack_deadline;
+    int timer_running;
+    float timer_deadline;
+
+    /* 统计 */
+    int ndata;          /* 发送的数据分组（含重传） */
+    int nretransmit;    /* 超时重传的分组数 */
+    int ntail;          /* 其中上层交完最后一条消息之后的重传 */
+    int ndropped;       /* 发送缓冲已满而被丢弃的上层消息 */
+    int nack;           /* 单独发送的ACK */
+    int npiggyback;     /* 搭载在数据分组上的ACK */
+    int ndata_in;       /* 收到的数据帧 */
+    int nduplicate;     /* 已交付过的帧，即对方多余的重传 */
+    int nout_of_order;  /* 跳过了期望序号而被丢弃（FEC 模式下是缓存）的帧 */
 };
 
-void tolayer3(int AorB, struct pkt packet);
-void tolayer5(int AorB, char datasent[20]);
-void starttimer(int AorB, float increment);
-void stoptimer(int AorB);
+struct gbn_entity *entity; /* nentities 个，第一次 entity_init 时分配 */
 
-/* Forward declaration of struct event */
-struct event;
+/* 把实际定时器对准最早的逻辑截止时间 */
+void arm_timer(int AorB) {
+    struct gbn_entity *e = &entity[AorB];
+    float earliest = -1;
 
-/********* STUDENTS WRITE THE NEXT SEVEN ROUTINES *********/
+    if (e->rto_deadline >= 0) earliest = e->rto_deadline;
+    if (e->ack_deadline >= 0 && (earliest < 0 || e->ack_deadline < earliest)) earliest = e->ack_deadline;
+    if (e->cumack_deadline >= 0 && (earliest < 0 || e->cumack_deadline < earliest)) earliest = e->cumack_deadline;
 
-/* Here I define some function prototypes to avoid warnings */
-/* in my compiler. Also I declared these functions void and */
-/* changed the implementation to match */
-void init();
-void generate_next_arrival();
-void insertevent(struct event *p);
+    if (e->timer_running && earliest == e->timer_deadline) {
+        return;
+    }
+    if (e->timer_running) {
+        stoptimer(AorB);
+        e->timer_running = 0;
+    }
+    if (earliest >= 0) {
+        starttimer(AorB, earliest > time ? earliest - time : 0);
+        e->timer_running = 1;
+        e->timer_deadline = earliest;
+    }
+}
 
-#define WINDOW_SIZE 8
-#define MAX_SEQ 1024
-#define TIMEOUT_INTERVAL 600.0
-#define CUMULATIVE_ACK_INTERVAL 2000.0
+/* 截止时间是否已到；剩余不足一个时间单位也算到期，以吸收浮点时间的舍入 */
+int is_due(float deadline) {
+    return deadline >= 0 && deadline - time < 1.0;
+}
 
-/* 全局变量 */
-struct msg send_buffer[MAX_SEQ];
-int send_base = 0;      /* 发送窗口基序号 */
-int next_seq = 0;       /* 下一个要发送的序号 */
-int expected_seq = 0;   /* 接收方期望的序列号 */
-
-/* 改进的校验和计算 */
-unsigned short compute_checksum(struct pkt* packet) {
-    unsigned short* data = (unsigned short*)packet;
-    int word_count = sizeof(struct pkt) / sizeof(unsigned short);
-    unsigned int sum = 0;
-    
-    for (int i = 0; i < word_count; i++) {
-        sum += data[i];
-        if (sum & 0xFFFF0000) {
-            /* 进位回卷 */
-            sum &= 0xFFFF;
-            sum++;
-        }
+/* 按窗口中的记录把第 seq_num 帧的消息装进 packet */
+void fill_frame(struct gbn_entity *e, int seq_num, struct pkt *packet) {
+    int first = e->frame_first[seq_num % WINDOW_SIZE];
+    int count = e->frame_count[seq_num % WINDOW_SIZE];
+
+    packet->seqnum = seq_num;
+    packet->length = count * MSG_SIZE;
+    for (int i = 0; i < count; i++) {
+        memcpy(packet->payload + i * MSG_SIZE, e->send_buffer[(first + i) % e->buffer_cap].data, MSG_SIZE);
     }
-    
-    return ~(sum & 0xFFFF);
 }
 
-int is_corrupt(struct pkt* packet) {
-    return compute_checksum(packet) != packet->checksum;
+/* 把从 msg_next 开始的 count 条消息记为第 seq_num 帧，并算好载荷的校验和 */
+void make_frame(struct gbn_entity *e, int seq_num, int count) {
+    struct pkt frame;
+
+    e->frame_first[seq_num % WINDOW_SIZE] = e->msg_next;
+    e->frame_count[seq_num % WINDOW_SIZE] = count;
+    e->msg_next += count;
+    fill_frame(e, seq_num, &frame);
+    e->frame_sum[seq_num % WINDOW_SIZE] = pkt_payload_sum(&frame);
 }
 
-/* Send packet */
-void send_packet(int seq_num) {
+/* Send packet，同时搭载当前的累计ACK */
+void send_packet(int AorB, int seq_num) {
+    struct gbn_entity *e = &entity[AorB];
     struct pkt packet;
-    packet.seqnum = seq_num;
-    packet.acknum = 0;
-    strncpy(packet.payload, send_buffer[seq_num % MAX_SEQ].data, 20);
-    packet.checksum = compute_checksum(&packet);
-    
-    tolayer3(0, packet);
-    printf("Sent packet: seq=%d\n", seq_num);
+
+    fill_frame(e, seq_num, &packet);
+    packet.acknum = e->expected_seq - 1;
+    packet.checksum = pkt_checksum_finish(&packet, e->frame_sum[seq_num % WINDOW_SIZE]);
+
+    tolayer3(AorB, packet);
+    trace_printf("%s sent packet: seq=%d ack=%d\n", entity_name(AorB), seq_num, packet.acknum);
+
+    e->ndata++;
+    if (e->ack_pending) {
+        e->npiggyback++;
+        e->ack_pending = 0;
+        e->ack_deadline = -1;
+    }
 }
 
 /* Send ACK */
-void send_ack(int ack_num) {
+void send_ack(int AorB) {
+    struct gbn_entity *e = &entity[AorB];
     struct pkt ack_packet;
-    ack_packet.seqnum = 0;
-    ack_packet.acknum = ack_num;
+    ack_packet.seqnum = NO_DATA;
+    ack_packet.acknum = e->expected_seq - 1;
     ack_packet.checksum = 0;
-    memset(ack_packet.payload, 0, 20);
-    ack_packet.checksum = compute_checksum(&ack_packet);
-    
-    tolayer3(1, ack_packet);
-    printf("B sent ACK: ack=%d\n", ack_num);
-}
-
-/* A_output - 发送方应用层调用 */
-void A_output(struct msg message) {
-    /* Buffer the message */
-    send_buffer[next_seq % MAX_SEQ] = message;
-    
-    /* If window has space, send immediately */
-    if (next_seq < send_base + WINDOW_SIZE) {
-        send_packet(next_seq);
-        
-        /* Start timer if this is the first packet in window */
-        if (send_base == next_seq) {
-            starttimer(0, TIMEOUT_INTERVAL);
-        }
-        
-        next_seq++;
-    } else {
-        printf("Window full, packet %d buffered\n", next_seq);
-        next_seq++;
+    ack_packet.length = 0;
+    if (FEC) {
+        /* 带回接收方估计的丢失率（万分比），发送方据此调整 k */
+        int loss = (int)(e->fec_rx->loss_est * 10000);
+        memcpy(ack_packet.payload, &loss, sizeof(int));
+        ack_packet.length = sizeof(int);
     }
+    ack_packet.checksum = pkt_checksum(&ack_packet);
+
+    tolayer3(AorB, ack_packet);
+    trace_printf("%s sent ACK: ack=%d\n", entity_name(AorB), ack_packet.acknum);
+
+    e->nack++;
+    e->ack_pending = 0;
+    e->ack_deadline = -1;
 }
 
-/* A_input - 发送方网络层调用 */
-void A_input(struct pkt packet) {
-    if (is_corrupt(&packet)) {
-        printf("A received corrupted ACK: ack=%d\n", packet.acknum);
+/* 新帧加入FEC组，组满时发送校验帧 */
+void send_parity(int AorB, int seq_num) {
+    struct gbn_entity *e = &entity[AorB];
+    struct pkt frame, parity;
+
+    fill_frame(e, seq_num, &frame);
+    if (!fec_add(e->fec_tx, seq_num, &frame, &parity)) {
         return;
     }
-    
-    printf("A received valid ACK: ack=%d\n", packet.acknum);
-    
-    /* 累计确认：移动窗口基序号 */
-    if (packet.acknum >= send_base && packet.acknum < next_seq) {
-        send_base = packet.acknum + 1;
-        
-        /* 如果还有未确认的分组，重启定时器 */
-        if (send_base < next_seq) {
-            stoptimer(0);
-            starttimer(0, TIMEOUT_INTERVAL);
-        } else {
-            stoptimer(0);
-        }
-        
-        /* 发送窗口内新的分组 */
-        while (send_base + WINDOW_SIZE > next_seq && next_seq < MAX_SEQ) {
-            send_packet(next_seq);
-            next_seq++;
-        }
+    parity.acknum = e->expected_seq - 1;
+    parity.checksum = pkt_checksum(&parity);
+
+    tolayer3(AorB, parity);
+    trace_printf("%s sent parity: seq=[%d, %d]\n", entity_name(AorB), seq_num - e->fec_tx->group_k + 1, seq_num);
+
+    if (e->ack_pending) {
+        e->npiggyback++;
+        e->ack_pending = 0;
+        e->ack_deadline = -1;
     }
 }
 
-/* A_timerinterrupt - 发送方超时处理 */
-void A_timerinterrupt() {
-    printf("超时，重传窗口 [%d, %d) 的分组\n", send_base, next_seq);
-    
-    /* 重传所有未确认的分组 */
-    for (int i = send_base; i < next_seq; i++) {
-        send_packet(i);
+/* 把一帧拆开逐条交付到应用层 */
+void deliver_frame(int AorB, struct pkt *frame) {
+    for (int i = 0; i + MSG_SIZE <= frame->length; i += MSG_SIZE) {
+        tolayer5(AorB, frame->payload + i);
     }
-    
-    /* 重启定时器 */
-    starttimer(0, TIMEOUT_INTERVAL);
 }
 
-/* B_input - 接收方网络层调用 */
-void B_input(struct pkt packet) {
-    if (is_corrupt(&packet)) {
-        printf("B收到损坏的分组: seq=%d\n", packet.seqnum);
-        /* 发送最近正确接收的ACK */
-        send_ack(expected_seq - 1);
-        return;
+/* 接收方处理第 seq 帧 */
+void receive_frame(int AorB, int seq, struct pkt *frame) {
+    struct gbn_entity *e = &entity[AorB];
+
+    if (FEC) {
+        fec_store(e->fec_rx, seq, frame);
     }
-    
+
     /* 检查是否是按序到达 */
-    if (packet.seqnum == expected_seq) {
-        /* 按序到达，交付到应用层 */
-        tolayer5(1, packet.payload);
-        expected_seq++;
-        
-        /* 发送ACK */
-        send_ack(expected_seq - 1);
-    } else {
-        /* 乱序到达，发送最近正确接收的ACK */
-        printf("B收到乱序分组: 期望=%d, 收到=%d\n", expected_seq, packet.seqnum);
-        send_ack(expected_seq - 1);
+    e->ndata_in++;
+    if (seq != e->expected_seq) {
+        trace_printf("%s收到乱序分组: 期望=%d, 收到=%d\n", entity_name(AorB), e->expected_seq, seq);
+        if (seq < e->expected_seq) {
+            e->nduplicate++;
+        } else {
+            e->nout_of_order++;
+        }
+        return;
     }
-}
-
-/* B_timerinterrupt - 接收方定期发送累计ACK */
-void B_timerinterrupt() {
-    printf("B发送累计ACK: ack=%d\n", expected_seq - 1);
-    send_ack(expected_seq - 1);
-    starttimer(1, CUMULATIVE_ACK_INTERVAL);
-}
 
-/* B_output - required by framework but not used for unidirectional transfer */
-void B_output(struct msg message) {
-    /* For unidirectional transfer, this won't be called */
-    printf("B_output called - not implemented for unidirectional transfer\n");
-}
+    /* 按序到达，交付到应用层 */
+    deliver_frame(AorB, frame);
+    e->expected_seq++;
 
-/* 初始化函数 */
-void A_init() {
-    send_base = 0;
-    next_seq = 0;
+    /* FEC 模式下保存了乱序到达的帧，能接上的一并交付 */
+    while (FEC && (frame = fec_lookup(e->fec_rx, e->expected_seq)) != NULL) {
+        deliver_frame(AorB, frame);
+        e->expected_seq++;
+    }
 }
 
-void B_init() {
-    expected_seq = 0;
-    starttimer(1, CUMULATIVE_ACK_INTERVAL);
-}
+/* 把缓存的消息组成帧，在窗口允许的范围内发送 */
+void send_window(int AorB) {
+    struct gbn_entity *e = &entity[AorB];
+    int per_frame = mss / MSG_SIZE;
 
-/*****************************************************************
-***************** NETWORK EMULATION CODE STARTS BELOW ***********
-The code below emulates the layer 3 and below network environment:
-  - emulates the tranmission and delivery (possibly with bit-level corruption
-    and packet loss) of packets across the layer 3/4 interface
-  - handles the starting/stopping of a timer, and generates timer
-    interrupts (resulting in calling students timer handler).
-  - generates message to be sent (passed from later 5 to 4)
-
-THERE IS NOT REASON THAT ANY STUDENT SHOULD HAVE TO READ OR UNDERSTAND
-THE CODE BELOW.  YOU SHOLD NOT TOUCH, OR REFERENCE (in your code) ANY
-OF THE DATA STRUCTURES BELOW.  If you're interested in how I designed
-the emulator, you're welcome to look at the code - but again, you should have
-to, and you defeinitely should not have to modify
-******************************************************************/
-
-struct event
-{
-    float evtime;       /* event time */
-    int evtype;         /* event type code */
-    int eventity;       /* entity where event occurs */
-    struct pkt *pktptr; /* ptr to packet (if any) assoc w/ this event */
-    struct event *prev;
-    struct event *next;
-};
-struct event *evlist = NULL; /* the event list */
-
-/* possible events: */
-#define TIMER_INTERRUPT 0
-#define FROM_LAYER5 1
-#define FROM_LAYER3 2
-
-#define OFF 0
-#define ON 1
-#define A 0
-#define B 1
-
-int TRACE = 1;   /* for my debugging */
-int nsim = 0;    /* number of messages from 5 to 4 so far */
-int nsimmax = 0; /* number of msgs to generate, then stop */
-float time = (float)0.000;
-float lossprob;    /* probability that a packet is dropped  */
-float corruptprob; /* probability that one bit is packet is flipped */
-float lambda;      /* arrival rate of messages from layer 5 */
-int ntolayer3;     /* number sent into layer 3 */
-int nlost;         /* number lost in media */
-int ncorrupt;      /* number corrupted by media*/
-
-void main()
-{
-    struct event *eventptr;
-    struct msg msg2give;
-    struct pkt pkt2give;
-
-    int i, j;
-    /* char c; // Unreferenced local variable removed */
-
-    init();
-    A_init();
-    B_init();
-
-    while (1)
-    {
-        eventptr = evlist; /* get next event to simulate */
-        if (eventptr == NULL)
-            goto terminate;
-        evlist = evlist->next; /* remove this event from event list */
-        if (evlist != NULL)
-            evlist->prev = NULL;
-        if (TRACE >= 2)
-        {
-            printf("\nEVENT time: %f,", eventptr->evtime);
-            printf("  type: %d", eventptr->evtype);
-            if (eventptr->evtype == 0)
-                printf(", timerinterrupt  ");
-            else if (eventptr->evtype == 1)
-                printf(", fromlayer5 ");
-            else
-                printf(", fromlayer3 ");
-            printf(" entity: %d\n", eventptr->eventity);
-        }
-        time = eventptr->evtime; /* update time to next event time */
-        if (nsim == nsimmax)
-            break; /* all done with simulation */
-        if (eventptr->evtype == FROM_LAYER5)
-        {
-            generate_next_arrival(); /* set up future arrival */
-            /* fill in msg to give with string of same letter */
-            j = nsim % 26;
-            for (i = 0; i < 20; i++)
-                msg2give.data[i] = 97 + j;
-            if (TRACE > 2)
-            {
-                printf("          MAINLOOP: data given to student: ");
-                for (i = 0; i < 20; i++)
-                    printf("%c", msg2give.data[i]);
-                printf("\n");
-            }
-            nsim++;
-            if (eventptr->eventity == A)
-                A_output(msg2give);
-            else
-                B_output(msg2give);
+    while (e->msg_next < e->buffer_end && e->next_seq < e->send_base + WINDOW_SIZE) {
+        int count = e->buffer_end - e->msg_next;
+        if (count > per_frame) {
+            count = per_frame;
         }
-        else if (eventptr->evtype == FROM_LAYER3)
-        {
-            pkt2give.seqnum = eventptr->pktptr->seqnum;
-            pkt2give.acknum = eventptr->pktptr->acknum;
-            pkt2give.checksum = eventptr->pktptr->checksum;
-            for (i = 0; i < 20; i++)
-                pkt2give.payload[i] = eventptr->pktptr->payload[i];
-            if (eventptr->eventity == A) /* deliver packet by calling */
-                A_input(pkt2give);       /* appropriate entity */
-            else
-                B_input(pkt2give);
-            free(eventptr->pktptr); /* free the memory for packet */
+        /* Nagle：不满的帧等到没有未确认数据时再发 */
+        if (NAGLE && count < per_frame && e->send_base < e->next_seq) {
+            break;
         }
-        else if (eventptr->evtype == TIMER_INTERRUPT)
-        {
-            if (eventptr->eventity == A)
-                A_timerinterrupt();
-            else
-                B_timerinterrupt();
+        make_frame(e, e->next_seq, count);
+        send_packet(AorB, e->next_seq);
+        if (FEC) {
+            send_parity(AorB, e->next_seq);
         }
-        else
-        {
-            printf("INTERNAL PANIC: unknown event type \n");
+
+        /* Start timer if this is the first packet in window */
+        if (e->send_base == e->next_seq) {
+            e->rto_deadline = time + TIMEOUT_INTERVAL;
         }
-        free(eventptr);
-    }
 
-terminate:
-   printf(" Simulator terminated at time %f\n after sending %d msgs from layer5\n",time,nsim);
+        e->next_seq++;
+    }
 }
 
-void init() /* initialize the simulator */
-{
-    int i;
-    float sum, avg;
-    float jimsrand();
-
-    printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
-    printf("Enter the number of messages to simulate: ");
-    scanf("%d", &nsimmax);
-    printf("Enter  packet loss probability [enter 0.0 for no loss]:");
-    scanf("%f", &lossprob);
-    printf("Enter packet corruption probability [0.0 for no corruption]:");
-    scanf("%f", &corruptprob);
-   printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
-   scanf("%f",&lambda);
-   printf("Enter TRACE:");
-   scanf("%d",&TRACE);
-
-   srand(9999);              /* init random number generator */
-   sum = (float)0.0;         /* test random number generator for students */
-   for (i=0; i<1000; i++)
-      sum=sum+jimsrand();    /* jimsrand() should be uniform in [0,1] */
-   avg = sum/(float)1000.0;
-   if (avg < 0.25 || avg > 0.75) {
-        printf("It is likely that random number generation on your machine\n");
-        printf("is different from what this emulator expects.  Please take\n");
-        printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
-        exit(0);
+/* 发送缓冲加倍，未确认和未发送的消息按新的大小重新排放 */
+void grow_buffer(struct gbn_entity *e) {
+    int cap = e->buffer_cap * 2;
+    struct msg *buffer = malloc(cap * sizeof(struct msg));
+
+    for (int i = e->msg_base; i < e->buffer_end; i++) {
+        buffer[i % cap] = e->send_buffer[i % e->buffer_cap];
     }
+    free(e->send_buffer);
+    e->send_buffer = buffer;
+    e->buffer_cap = cap;
+}
 
-   ntolayer3 = 0;
-   nlost = 0;
-   ncorrupt = 0;
+/* 上层交给 AorB 的消息 */
+void entity_output(int AorB, struct msg message) {
+    struct gbn_entity *e = &entity[AorB];
 
-   time=(float)0.0;                    /* initialize time to 0.0 */
-   generate_next_arrival();     /* initialize event list */
+    if (e->buffer_end - e->msg_base >= e->buffer_cap) {
+        if (e->buffer_cap >= MAX_SEQ) {
+            trace_printf("%s send buffer full, message dropped\n", entity_name(AorB));
+            e->ndropped++;
+            layer5_dropped(AorB);
+            return;
+        }
+        grow_buffer(e);
+    }
+
+    /* Buffer the message, send it if the window has space */
+    e->send_buffer[e->buffer_end % e->buffer_cap] = message;
+    e->buffer_end++;
+    if (e->next_seq >= e->send_base + WINDOW_SIZE) {
+        trace_printf("Window full, message %d buffered\n", e->buffer_end - 1);
+    }
+    send_window(AorB);
+    arm_timer(AorB);
 }
 
-/****************************************************************************/
-/* jimsrand(): return a float in range [0,1].  The routine below is used to */
-/* isolate all random number generation in one location.  We assume that the*/
-/* system-supplied rand() function return an int in therange [0,mmm]        */
-/****************************************************************************/
-float jimsrand()
-{
-    double mmm = RAND_MAX;     /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
-    float x;                   /* individual students may need to change mmm */
-    x = (float)(rand() / mmm); /* x should be uniform in [0,1] */
-    return (x);
+/* 收尾（-F）：发出的都已确认、缓冲里没有消息、也没有欠着的ACK或累计ACK */
+int entity_idle(int AorB) {
+    struct gbn_entity *e = &entity[AorB];
+
+    return e->msg_base == e->buffer_end && !e->ack_pending && e->cumack_deadline < 0;
 }
 
-/********************* EVENT HANDLINE ROUTINES *******/
-/*  The next set of routines handle the event list   */
-/*****************************************************/
-
-void generate_next_arrival()
-{
-    double x;
-    struct event *evptr;
-    /* char *malloc(); // malloc redefinition removed */
-    /* float ttime; // Unreferenced local variable removed */
-    /* int tempint; // Unreferenced local variable removed */
-
-    if (TRACE > 2)
-        printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
-
-    x = lambda * jimsrand() * 2; /* x is uniform on [0,2*lambda] */
-                                 /* having mean of lambda        */
-    evptr = (struct event *)malloc(sizeof(struct event));
-    evptr->evtime = (float)(time + x);
-    evptr->evtype = FROM_LAYER5;
-    if (BIDIRECTIONAL && (jimsrand() > 0.5))
-        evptr->eventity = B;
-    else
-        evptr->eventity = A;
-    insertevent(evptr);
+/* 时间序列（-T）：GBN 没有确认位图，接收方也不缓存乱序帧 */
+int entity_metric(int AorB, int metric) {
+    struct gbn_entity *e = &entity[AorB];
+
+    switch (metric) {
+    case METRIC_INFLIGHT:
+        return e->next_seq - e->send_base;
+    case METRIC_SENDBUF:
+        return e->buffer_end - e->msg_next;
+    case METRIC_TIMERS:
+        return (e->rto_deadline >= 0) + (e->ack_deadline >= 0) + (e->cumack_deadline >= 0);
+    default:
+        return -1;
+    }
 }
 
-void insertevent(struct event *p)
-{
-    struct event *q, *qold;
+/* 检查点（-C/-R）：结构体整个写出，指针指向的发送缓冲和 FEC 状态另外写，恢复时重新分配 */
+void entity_checkpoint(int AorB, int restoring) {
+    struct gbn_entity *e;
 
-    if (TRACE > 2)
-    {
-        printf("            INSERTEVENT: time is %lf\n", time);
-        printf("            INSERTEVENT: future time will be %lf\n", p->evtime);
-    }
-    q = evlist; /* q points to header of list in which p struct inserted */
-    if (q == NULL)
-    { /* list is empty */
-        evlist = p;
-        p->next = NULL;
-        p->prev = NULL;
+    if (entity == NULL) {
+        entity = calloc(nentities, sizeof(struct gbn_entity));
     }
-    else
-    {
-        for (qold = q; q != NULL && p->evtime > q->evtime; q = q->next)
-            qold = q;
-        if (q == NULL)
-        { /* end of list */
-            qold->next = p;
-            p->prev = qold;
-            p->next = NULL;
-        }
-        else if (q == evlist)
-        { /* front of list */
-            p->next = evlist;
-            p->prev = NULL;
-            p->next->prev = p;
-            evlist = p;
-        }
-        else
-        { /* middle of list */
-            p->next = q;
-            p->prev = q->prev;
-            q->prev->next = p;
-            q->prev = p;
+    e = &entity[AorB];
+    checkpoint_data(e, sizeof(*e));
+    if (restoring) {
+        e->send_buffer = malloc(e->buffer_cap * sizeof(struct msg));
+        if (FEC) {
+            e->fec_tx = malloc(sizeof(struct fec_encoder));
+            e->fec_rx = malloc(sizeof(struct fec_decoder));
         }
     }
+    checkpoint_data(e->send_buffer, e->buffer_cap * sizeof(struct msg));
+    if (FEC) {
+        checkpoint_data(e->fec_tx, sizeof(struct fec_encoder));
+        checkpoint_data(e->fec_rx, sizeof(struct fec_decoder));
+    }
 }
 
-void printevlist()
-{
-    struct event *q;
-    /* int i; // Unreferenced local variable removed */
-    printf("--------------\nEvent List Follows:\n");
-    for (q = evlist; q != NULL; q = q->next)
-    {
-    printf("Event time: %f, type: %d entity: %d\n",q->evtime,q->evtype,q->eventity);
+/* 饱和源（-S）：窗口有空位时才向上层要新消息，消息不会在发送缓冲里越积越多 */
+int entity_ready(int AorB) {
+    struct gbn_entity *e = &entity[AorB];
+
+    return e->next_seq < e->send_base + WINDOW_SIZE;
+}
+
+/* 收到了数据：CUMULATIVE_ACK_INTERVAL 之后再重复一次累计ACK，
+   以防这期间的ACK全部丢失；已经安排了就不再推迟 */
+void arm_cumack(struct gbn_entity *e) {
+    if (e->cumack_deadline < 0) {
+        e->cumack_deadline = time + CUMULATIVE_ACK_INTERVAL;
     }
-    printf("--------------\n");
 }
 
-/********************** Student-callable ROUTINES ***********************/
-
-/* called by students routine to cancel a previously-started timer */
-void stoptimer(int AorB) /* A or B is trying to stop timer */
-{
-    struct event *q; /* ,*qold; // Unreferenced local variable removed */
-
-    if (TRACE > 2)
-        printf("          STOP TIMER: stopping timer at %f\n", time);
-    /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-    for (q = evlist; q != NULL; q = q->next)
-        if ((q->evtype == TIMER_INTERRUPT && q->eventity == AorB))
-        {
-            /* remove this event */
-            if (q->next == NULL && q->prev == NULL)
-                evlist = NULL;        /* remove first and only event on list */
-            else if (q->next == NULL) /* end of list - there is one in front */
-                q->prev->next = NULL;
-            else if (q == evlist)
-            { /* front of list - there must be event after */
-                q->next->prev = NULL;
-                evlist = q->next;
-            }
-            else
-            { /* middle of list */
-                q->next->prev = q->prev;
-                q->prev->next = q->next;
+/* 处理到达 AorB 的分组：先作为接收方处理数据，再作为发送方处理ACK */
+void entity_input(int AorB, struct pkt packet) {
+    struct gbn_entity *e = &entity[AorB];
+
+    if (pkt_is_corrupt(&packet)) {
+        trace_printf("%s received corrupted packet: seq=%d\n", entity_name(AorB), packet.seqnum);
+        /* 重发最近正确接收的ACK；还没收到过数据的一方没有ACK可发 */
+        e->ack_pending = e->expected_seq > 0;
+    } else {
+        if (packet.seqnum == FEC_PARITY) {
+            struct pkt recovered;
+            int seq = fec_recover(e->fec_rx, &packet, &recovered);
+            if (seq >= 0) {
+                trace_printf("%s用校验帧还原分组: seq=%d\n", entity_name(AorB), seq);
+                receive_frame(AorB, seq, &recovered);
+                e->ack_pending = 1;
+                arm_cumack(e);
             }
-            free(q);
-            return;
+        } else if (packet.seqnum != NO_DATA) {
+            receive_frame(AorB, packet.seqnum, &packet);
+            e->ack_pending = 1;
+            arm_cumack(e);
+        } else if (FEC && packet.length >= (int)sizeof(int)) {
+            int loss;
+            memcpy(&loss, packet.payload, sizeof(int));
+            fec_set_loss(e->fec_tx, loss / 10000.0);
         }
-    printf("Warning: unable to cancel your timer. It wasn't running.\n");
-}
 
-void starttimer(int AorB, float increment) /* A or B is trying to stop timer */
-{
-
-    struct event *q;
-    struct event *evptr;
-    /* char *malloc(); // malloc redefinition removed */
-
-    if (TRACE > 2)
-        printf("          START TIMER: starting timer at %f\n", time);
-    /* be nice: check to see if timer is already started, if so, then  warn */
-    /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-    for (q = evlist; q != NULL; q = q->next)
-        if ((q->evtype == TIMER_INTERRUPT && q->eventity == AorB))
-        {
-            printf("Warning: attempt to start a timer that is already started\n");
-            return;
+        /* 累计确认：移动窗口基序号 */
+        if (packet.acknum >= e->send_base && packet.acknum < e->next_seq) {
+            trace_printf("%s received valid ACK: ack=%d\n", entity_name(AorB), packet.acknum);
+            e->send_base = packet.acknum + 1;
+            e->msg_base = e->frame_first[packet.acknum % WINDOW_SIZE] +
+                          e->frame_count[packet.acknum % WINDOW_SIZE];
+
+            /* 如果还有未确认的分组，重启定时器 */
+            if (e->send_base < e->next_seq) {
+                e->rto_deadline = time + TIMEOUT_INTERVAL;
+            } else {
+                e->rto_deadline = -1;
+            }
+
+            /* 发送窗口内新的分组，顺带捎上ACK */
+            send_window(AorB);
         }
+    }
 
-    /* create future event for when timer goes off */
-    evptr = (struct event *)malloc(sizeof(struct event));
-    evptr->evtime = (float)(time + increment);
-    evptr->evtype = TIMER_INTERRUPT;
-    evptr->eventity = AorB;
-    insertevent(evptr);
+    if (e->ack_pending) {
+        if (!PIGGYBACK) {
+            send_ack(AorB);
+        } else if (e->ack_deadline < 0) {
+            e->ack_deadline = time + ACK_HOLD;
+        }
+    }
+    arm_timer(AorB);
 }
 
-/************************** TOLAYER3 ***************/
-void tolayer3(int AorB, struct pkt packet) /* A or B is trying to stop timer */
-{
-    struct pkt *mypktptr;
-    struct event *evptr, *q;
-    /* char *malloc(); // malloc redefinition removed */
-    float lastime, x, jimsrand();
-    int i;
-
-    ntolayer3++;
-
-    /* simulate losses: */
-    if (jimsrand() < lossprob)
-    {
-        nlost++;
-        if (TRACE > 0)
-            printf("          TOLAYER3: packet being lost\n");
-        return;
+/* 定时器到期：检查三个逻辑定时器 */
+void entity_timerinterrupt(int AorB) {
+    struct gbn_entity *e = &entity[AorB];
+
+    e->timer_running = 0;
+
+    if (is_due(e->rto_deadline)) {
+        trace_printf("%s超时，重传窗口 [%d, %d) 的分组\n", entity_name(AorB), e->send_base, e->next_seq);
+
+        /* 重传所有未确认的分组 */
+        for (int i = e->send_base; i < e->next_seq; i++) {
+            send_packet(AorB, i);
+            e->nretransmit++;
+            if (layer5_done(AorB)) {
+                e->ntail++;
+            }
+        }
+
+        /* 重启定时器 */
+        e->rto_deadline = time + TIMEOUT_INTERVAL;
     }
 
-    /* make a copy of the packet student just gave me since he/she may decide */
-    /* to do something with the packet after we return back to him/her */
-    mypktptr = (struct pkt *)malloc(sizeof(struct pkt));
-    mypktptr->seqnum = packet.seqnum;
-    mypktptr->acknum = packet.acknum;
-    mypktptr->checksum = packet.checksum;
-    for (i = 0; i < 20; i++)
-        mypktptr->payload[i] = packet.payload[i];
-    if (TRACE > 2)
-    {
-        printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
-               mypktptr->acknum, mypktptr->checksum);
-        for (i = 0; i < 20; i++)
-            printf("%c", mypktptr->payload[i]);
-        printf("\n");
+    if (is_due(e->ack_deadline)) {
+        /* 等不到反向数据，单独发送ACK */
+        send_ack(AorB);
     }
 
-    /* create future event for arrival of packet at the other side */
-    evptr = (struct event *)malloc(sizeof(struct event));
-    evptr->evtype = FROM_LAYER3;      /* packet will pop out from layer3 */
-    evptr->eventity = (AorB + 1) % 2; /* event occurs at other entity */
-    evptr->pktptr = mypktptr;         /* save ptr to my copy of packet */
-                                      /* finally, compute the arrival time of packet at the other end.
-                                         medium can not reorder, so make sure packet arrives between 1 and 10
-                                         time units after the latest arrival time of packets
-                                         currently in the medium on their way to the destination */
-    lastime = time;
-    /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-    for (q = evlist; q != NULL; q = q->next)
-        if ((q->evtype == FROM_LAYER3 && q->eventity == evptr->eventity))
-            lastime = q->evtime;
-    evptr->evtime = lastime + 1 + 9 * jimsrand();
-
-    /* simulate corruption: */
-    if (jimsrand() < corruptprob)
-    {
-        ncorrupt++;
-        if ((x = jimsrand()) < .75)
-            mypktptr->payload[0] = 'Z'; /* corrupt payload */
-        else if (x < .875)
-            mypktptr->seqnum = 999999;
-        else
-            mypktptr->acknum = 999999;
-        if (TRACE > 0)
-            printf("          TOLAYER3: packet being corrupted\n");
+    if (is_due(e->cumack_deadline)) {
+        trace_printf("%s发送累计ACK: ack=%d\n", entity_name(AorB), e->expected_seq - 1);
+        send_ack(AorB);
+        e->cumack_deadline = -1; /* 等下一次收到数据再安排 */
     }
 
-    if (TRACE > 2)
-        printf("          TOLAYER3: scheduling arrival on other side\n");
-    insertevent(evptr);
+    arm_timer(AorB);
 }
 
-void tolayer5(int AorB, char datasent[20])
-{
-    int i;
-    if (TRACE > 2)
-    {
-        printf("          TOLAYER5: data received: ");
-        for (i = 0; i < 20; i++)
-            printf("%c", datasent[i]);
-        printf("\n");
+void entity_init(int AorB) {
+    struct gbn_entity *e;
+
+    if (entity == NULL) {
+        entity = calloc(nentities, sizeof(struct gbn_entity));
+    }
+    e = &entity[AorB];
+    memset(e, 0, sizeof(*e));
+    e->buffer_cap = BUFFER_INIT;
+    e->send_buffer = malloc(BUFFER_INIT * sizeof(struct msg));
+    if (FEC) {
+        e->fec_tx = malloc(sizeof(struct fec_encoder));
+        e->fec_rx = malloc(sizeof(struct fec_decoder));
+        fec_encoder_init(e->fec_tx, WINDOW_SIZE - 1);
+        fec_decoder_init(e->fec_rx);
     }
-}
\ No newline at end of file
+    e->rto_deadline = -1;
+    e->ack_deadline = -1;
+    e->cumack_deadline = -1; /* 收到数据以后才需要重复累计ACK */
+}
+
+/* 运行结束时由模拟器调用，打印协议统计；多条流时按 A、B 两侧汇总 */
+void protocol_stats() {
+    for (int side = 0; side < 2; side++) {
+        struct gbn_entity sum;
+        int nparity = 0, nrecovered = 0;
+        char name[32];
+
+        memset(&sum, 0, sizeof(sum));
+        for (int id = side; id < nentities; id += 2) {
+            struct gbn_entity *e = &entity[id];
+            sum.ndata += e->ndata;
+            sum.nretransmit += e->nretransmit;
+            sum.ntail += e->ntail;
+            sum.ndropped += e->ndropped;
+            sum.nack += e->nack;
+            sum.npiggyback += e->npiggyback;
+            sum.ndata_in += e->ndata_in;
+            sum.nduplicate += e->nduplicate;
+            sum.nout_of_order += e->nout_of_order;
+            if (FEC) {
+                nparity += e->fec_tx->nparity;
+                nrecovered += e->fec_rx->nrecovered;
+            }
+        }
+
+        if (nflows == 1) {
+            sprintf(name, "%c", 'A' + side);
+            printf(" GBN %s: send_base=%d, next_seq=%d, data pkts: %d, retransmissions: %d, "
+                   "standalone ACKs: %d, piggybacked ACKs: %d\n",
+                   name, entity[side].send_base, entity[side].next_seq, sum.ndata,
+                   sum.nretransmit, sum.nack, sum.npiggyback);
+        } else {
+            sprintf(name, "%c, %d flows", 'A' + side, nflows);
+            printf(" GBN %s: data pkts: %d, retransmissions: %d, "
+                   "standalone ACKs: %d, piggybacked ACKs: %d\n",
+                   name, sum.ndata, sum.nretransmit, sum.nack, sum.npiggyback);
+        }
+        if (sum.ntail > 0) {
+            printf(" GBN %s: retransmissions after the last msg: %d\n", name, sum.ntail);
+        }
+        if (sum.ndropped > 0) {
+            printf(" GBN %s: msgs dropped with the send buffer full: %d\n", name, sum.ndropped);
+        }
+        if (sum.ndata_in > 0) {
+            printf(" GBN %s: data pkts received: %d, duplicates: %d, out of order: %d\n",
+                   name, sum.ndata_in, sum.nduplicate, sum.nout_of_order);
+        }
+        if (FEC && nflows == 1) {
+            printf(" GBN %s: parity pkts: %d, recovered without retransmission: %d, k: %d, "
+                   "loss estimate at the receiver: %f\n", name, nparity, nrecovered,
+                   entity[side].fec_tx->k, entity[side ^ 1].fec_rx->loss_est);
+        } else if (FEC) {
+            printf(" GBN %s: parity pkts: %d, recovered without retransmission: %d\n",
+                   name, nparity, nrecovered);
+        }
+    }
+}
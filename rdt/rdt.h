@@ -0,0 +1,130 @@
+#ifndef RDT_H
+#define RDT_H
+
+/*******************************************************************
+ ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
+
+   This code should be used for PA2, unidirectional or bidirectional
+   data transfer protocols (from A to B. Bidirectional transfer of data
+   is for extra credit and is not required).  Network properties:
+   - one way network delay averages five time units (longer if there
+     are other messages in the channel for GBN), but can be larger
+   - packets can be corrupted (either the header or the data portion)
+     or lost, according to user-defined probabilities
+   - packets will be delivered in the order in which they were sent
+     (although some can be lost), unless reordering is switched on.
+
+   The emulator itself lives in emulator.c; abp.c, gbn.c and sr.c only
+   contain the protocol entities and are each linked against it.  udp.c
+   is a second runtime for the same entities that sends their packets
+   over real UDP sockets on the loopback interface (make udp).
+**********************************************************************/
+
+/* Bidirectional transfer is switched on at run time with "-b fraction",   */
+/* the share of layer 5 messages that are generated at B; B_output is    */
+/* then called for those.                                                 */
+/* "-r rate" replaces the channel above by a bottleneck link with a rate  */
+/* in bytes per time unit, a propagation delay (-d) and a finite queue    */
+/* (-q, -Q); see the link model in emulator.c.  "-l ge:p,r" makes losses */
+/* bursty (Gilbert-Elliott) and "-e ber" flips individual bits instead of */
+/* the all-or-nothing corruption; see the channel models in emulator.c.   */
+/* "-o prob,depth" and "-D prob" give up in-order, exactly-once delivery. */
+/* "-n flows" runs that many independent A/B pairs over the same links   */
+/* and channels.                                                          */
+/* "-t file" puts routers between A and B: packets are forwarded hop by  */
+/* hop through the links and static routes listed in the file.           */
+/* "-P threads" runs the flows and the network as parallel logical       */
+/* processes; "-s seed" seeds the random numbers.                         */
+/* "-S" replaces the timed arrivals by saturated sources: layer 5 hands   */
+/* an entity a new message whenever entity_ready() says it can take one,  */
+/* which measures the most a protocol can carry.                          */
+/* "-a poisson", "-a onoff:alpha,on,off" and "-a trace:file" replace the  */
+/* uniform arrivals by a Poisson process, Pareto on/off bursts or the     */
+/* replay of a recorded trace; see the arrival processes in emulator.c.   */
+/* "-F" runs on after the last message until every flow has delivered    */
+/* what it can and gone idle, and reports the flow completion time.      */
+/* "-T interval,file[,metric...]" samples the protocol state every        */
+/* interval time units into file (CSV if it ends in .csv); see the time   */
+/* series sampler in emulator.c and entity_metric() below.                */
+/* "-C interval,file" writes a checkpoint of the whole simulation every   */
+/* interval time units and "-R file" resumes a run from one; see the      */
+/* checkpoints in emulator.c and entity_checkpoint() below.               */
+/* "-c precision" ends the run once goodput and latency are known to      */
+/* within that relative half-width; the number of messages is then only   */
+/* an upper limit.                                                        */
+/* "-k" draws the channel's and the arrivals' random decisions keyed by   */
+/* direction and packet number, so protocols run with the same seed see  */
+/* the same losses (common random numbers).                               */
+
+/* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
+/* 4 (students' code).  It contains the data (characters) to be delivered */
+/* to layer 5 via the students transport level protocol entities.         */
+#define MSG_SIZE 20
+struct msg
+{
+    char data[MSG_SIZE];
+};
+
+/* a packet is the data unit passed from layer 4 (students code) to layer */
+/* 3 (teachers code).  Note the pre-defined packet structure, which all   */
+/* students must follow.  length is the number of payload bytes in use;  */
+/* protocols that aggregate messages may carry up to mss bytes (-m);    */
+/* the extra room is for control headers such as FEC parity information. */
+#define MAX_MSS (20 * MSG_SIZE)
+#define MAX_PAYLOAD (MAX_MSS + 16)
+struct pkt
+{
+    int seqnum;
+    int acknum;
+    int checksum;
+    int length;
+    char payload[MAX_PAYLOAD];
+};
+#define PKT_HEADER_SIZE (sizeof(struct pkt) - MAX_PAYLOAD)
+
+/* emulator routines callable from the protocol entities */
+void tolayer3(int AorB, struct pkt packet);
+void tolayer5(int AorB, char datasent[20]);
+void starttimer(int AorB, float increment);
+void stoptimer(int AorB);
+
+/* protocol entity routines called by the emulator.  Entities are     */
+/* numbered 0 .. nentities-1: flow f has A = 2*f and B = 2*f+1, so the */
+/* peer of id is id^1 and id&1 tells the side (A or B).  The same ids  */
+/* are passed back to tolayer3, tolayer5 and the timer routines.       */
+void entity_output(int id, struct msg message);
+void entity_input(int id, struct pkt packet);
+void entity_timerinterrupt(int id);
+void entity_init(int id);
+int entity_ready(int id); /* with -S: would entity_output take a message now? */
+int entity_idle(int id);  /* with -F: nothing left to send or acknowledge? */
+int entity_metric(int id, int metric); /* with -T: one of the METRIC_ values */
+                                       /* below, -1 if the protocol has none */
+/* with -C and -R: pass all the state of entity id through           */
+/* checkpoint_data(), which writes it or, when restoring, reads it    */
+/* back; the entity is then not initialized, and what its pointers    */
+/* pointed to must be allocated again before it is read               */
+void entity_checkpoint(int id, int restoring);
+void protocol_stats(); /* print protocol specific counters at the end of a run */
+
+/* protocol state that -T samples; each is summed over the entities */
+#define METRIC_INFLIGHT 0 /* frames sent and not yet acknowledged (next_seq - send_base) */
+#define METRIC_ACKED 1    /* of those, acknowledged out of order (SR acked bitmap) */
+#define METRIC_RCVBUF 2   /* frames the receiver holds back for a gap */
+#define METRIC_SENDBUF 3  /* layer 5 messages waiting to go into a frame */
+#define METRIC_TIMERS 4   /* logical timers running: retransmission, delayed ACK etc. */
+#define NMETRICS 5
+
+extern __thread float time; /* current simulated time, per thread with -P */
+extern int TRACE;
+extern int mss;    /* largest payload a protocol may put in one packet */
+extern int nflows, nentities;
+
+const char *entity_name(int id);         /* "A", "B", or "A7" etc. with -n */
+void trace_printf(const char *format, ...); /* printf, only with TRACE > 0 */
+int layer5_done(int id); /* has layer 5 handed the flow of id its last message? */
+void layer5_dropped(int id); /* the protocol discards the message layer 5 */
+                             /* has just handed entity id                 */
+void checkpoint_data(void *buf, int len); /* for entity_checkpoint() */
+
+#endif
@@ -2,287 +2,688 @@
 #include <stdlib.h>
 #include <string.h>
 
-/*******************************************************************
- ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
-**********************************************************************/
+#include "rdt.h"
+#include "checksum.h"
+#include "fec.h"
 
 /**
  * SR（Selective Repeat）协议 伪代码，每个分组应该各自维护一个独立的计时器，
  * 而不是像 Go-Back-N（GBN）那样只有一个全局定时器
+ *
+ * 模拟器只给每个实体提供一个定时器，这里记录每个分组的发送时间，
+ * 单个定时器总是对准最早到期的那个分组或延迟ACK。
+ *
+ * 内部使用不回绕的绝对序号，线路上的 seqnum 为绝对序号 % MAX_SEQ。
+ *
+ * A 和 B 都同时运行发送方和接收方（全双工）。每个数据分组的 acknum
+ * 可以搭载一个待发送的ACK，没有反向数据时等待 ACK_HOLD 后单独发送。
+ *
+ * 序号编号的是帧：一帧装入 mss/MSG_SIZE 条排队中的上层消息（-m，默认一条）。
+ * 按 Nagle 规则，不满的帧只在没有未确认数据时才发送，否则等ACK到来再组帧。
+ *
+ * 编译时 -DFEC=1 打开前向纠错（见 fec.h），还原出的帧按正常到达的帧处理。
  */
 
-// todo: 定时器
+/********* STUDENTS WRITE THE NEXT SEVEN ROUTINES *********/
 
-#define BIDIRECTIONAL 0
+#ifndef WINDOW_SIZE
+#define WINDOW_SIZE 4  /* SR窗口大小通常较小，编译时可用 -DWINDOW_SIZE=n 覆盖（见 tune.c） */
+#endif
+#ifndef MAX_SEQ
+#define MAX_SEQ (2 * WINDOW_SIZE) /* 序列号空间，至少是窗口大小的2倍 */
+#endif
+#if MAX_SEQ < 2 * WINDOW_SIZE
+#error "MAX_SEQ 至少是 WINDOW_SIZE 的2倍，否则接收方分不清新帧和重传"
+#endif
+#define BUFFER_SIZE 1024 /* 发送缓冲最多能容纳的上层消息数 */
+#define BUFFER_INIT 16   /* 发送缓冲的初始大小，不够时加倍直到 BUFFER_SIZE */
+#ifndef TIMEOUT_INTERVAL
+#define TIMEOUT_INTERVAL 600.0 /* 同上，-DTIMEOUT_INTERVAL=t */
+#endif
+#define NAK_INTERVAL 40.0 /* 同一个空洞两次NAK之间的最小间隔，约两个RTT */
+#define ACK_HOLD 5.0      /* 没有反向数据可搭载时，ACK最多等待的时间，约半个RTT */
+#define NO_DATA -1        /* seqnum 为 NO_DATA 的分组是单独的ACK/NAK */
+#define NO_ACK MAX_SEQ    /* acknum 为 NO_ACK 的数据分组没有搭载ACK */
 
-extern float time;
+#ifndef GAP_NAK
+#define GAP_NAK 1 /* 接收方对窗口内的空洞发送NAK，编译时 -DGAP_NAK=0 关闭以作对比 */
+#endif
 
-struct msg {
-    char data[20];
-};
+#ifndef PIGGYBACK
+#define PIGGYBACK 1 /* ACK搭载在反向数据上，编译时 -DPIGGYBACK=0 关闭以作对比 */
+#endif
+
+#ifndef NAGLE
+#define NAGLE 1 /* 有未确认数据时暂缓发送不满的帧，-DNAGLE=0 关闭 */
+#endif
+
+#ifndef FEC
+#define FEC 0 /* 每 k 个新帧发一个异或校验帧，-DFEC=1 打开 */
+#endif
+
+/* 每个实体的状态 */
+struct sr_entity {
+    /* 发送方数据结构 */
+    struct msg *send_buffer; /* 上层消息的环形缓冲 */
+    int buffer_cap;  /* send_buffer 的大小 */
+    int msg_base;    /* 最早未确认的消息 */
+    int msg_next;    /* 下一条还没装进帧的消息 */
+    int buffer_end;  /* 已缓存的上层消息之后的第一条 */
+    int frame_first[MAX_SEQ]; /* 窗口内每一帧的第一条消息 */
+    int frame_count[MAX_SEQ]; /* 窗口内每一帧的消息条数 */
+    unsigned int frame_sum[MAX_SEQ]; /* 每一帧载荷的校验和中间值，重传时只补头部 */
+    int send_base;   /* 最早未确认的分组 */
+    int next_seq;    /* 下一个要发送的分组 */
+    int acked[MAX_SEQ];        /* 标记哪些分组已被确认 */
+    float timer_start[MAX_SEQ]; /* 每个分组的定时器开始时间 */
 
-struct pkt {
-    int seqnum;
-    int acknum;
-    int checksum;
-    char payload[20];
+    /* 接收方数据结构 */
+    struct pkt recv_buffer[MAX_SEQ]; /* 乱序到达、等待交付的帧 */
+    int recv_base;
+    int received[MAX_SEQ];     /* 标记哪些分组已接收 */
+    float arrive_time[MAX_SEQ]; /* 乱序分组进入接收缓冲的时间 */
+    float nak_time[MAX_SEQ];    /* 该空洞上次发送NAK的时间，<0 表示还没发过 */
+    int pending_ack[MAX_SEQ];  /* 待发送的ACK（线路序号），不重复 */
+    int npending;
+    float ack_deadline;        /* 待发送ACK最晚的发送时间，<0 表示没有 */
+
+    /* 前向纠错 */
+    struct fec_encoder *fec_tx; /* 只在 FEC 打开时分配 */
+    struct fec_decoder *fec_rx;
+
+    int timer_running;
+    float timer_deadline;
+
+    /* 统计 */
+    int ndata;           /* 发送的数据分组（含重传） */
+    int nretransmit;     /* 超时重传 */
+    int nnak_retransmit; /* 收到NAK后的立即重传 */
+    int ntail;           /* 上层交完最后一条消息之后的重传（两种都算） */
+    int ndropped;        /* 发送缓冲已满而被丢弃的上层消息 */
+    int nnak;            /* 发送的NAK */
+    int nack;            /* 单独发送的ACK */
+    int npiggyback;      /* 搭载在数据分组上的ACK */
+    int nduplicate;      /* 收到的重复分组（已缓存或已交付），即对方多余的重传 */
+    int nbuffered;       /* 接收缓冲中的分组数 */
+    long buffered_sum;   /* 每次数据到达、交付完之后接收缓冲的占用之和 */
+    int buffered_max;
+    int ndata_in;        /* 收到的数据分组 */
+    int nhol;            /* 因前面有空洞而在接收缓冲中等待的分组数 */
+    double hol_time;     /* 这些分组等待交付的总时间 */
+    float hol_max;
 };
 
-void tolayer3(int AorB, struct pkt packet);
-void tolayer5(int AorB, char datasent[20]);
-void starttimer(int AorB, float increment);
-void stoptimer(int AorB);
+struct sr_entity *entity; /* nentities 个，第一次 entity_init 时分配 */
 
-/********* STUDENTS WRITE THE NEXT SEVEN ROUTINES *********/
+/* 把实际定时器对准最早到期的未确认分组或延迟ACK */
+void arm_timer(int AorB) {
+    struct sr_entity *e = &entity[AorB];
+    float earliest = e->ack_deadline;
 
-#define WINDOW_SIZE 4  /* SR窗口大小通常较小 */
-#define MAX_SEQ 8      /* 序列号空间，至少是窗口大小的2倍 */
-#define TIMEOUT_INTERVAL 600.0
-
-/* 发送方数据结构 */
-struct msg send_buffer[MAX_SEQ];
-int send_base = 0;
-int next_seq = 0;
-int acked[MAX_SEQ] = {0};  /* 标记哪些分组已被确认 */
-float timer_start[MAX_SEQ] = {0}; /* 每个分组的定时器开始时间 */
-
-/* 接收方数据结构 */
-struct msg recv_buffer[MAX_SEQ];
-int recv_base = 0;
-int received[MAX_SEQ] = {0}; /* 标记哪些分组已接收 */
-
-/* 校验和计算 */
-unsigned short compute_checksum(struct pkt* packet) {
-    unsigned short* data = (unsigned short*)packet;
-    int word_count = sizeof(struct pkt) / sizeof(unsigned short);
-    unsigned int sum = 0;
-    
-    for (int i = 0; i < word_count; i++) {
-        sum += data[i];
-        if (sum & 0xFFFF0000) {
-            sum &= 0xFFFF;
-            sum++;
+    for (int seq = e->send_base; seq < e->next_seq; seq++) {
+        float expiry = e->timer_start[seq % MAX_SEQ] + TIMEOUT_INTERVAL;
+        if (!e->acked[seq % MAX_SEQ] && (earliest < 0 || expiry < earliest)) {
+            earliest = expiry;
         }
     }
-    
-    return ~(sum & 0xFFFF);
+
+    if (e->timer_running && earliest == e->timer_deadline) {
+        return;
+    }
+    if (e->timer_running) {
+        stoptimer(AorB);
+        e->timer_running = 0;
+    }
+    if (earliest >= 0) {
+        starttimer(AorB, earliest > time ? earliest - time : 0);
+        e->timer_running = 1;
+        e->timer_deadline = earliest;
+    }
 }
 
-int is_corrupt(struct pkt* packet) {
-    return compute_checksum(packet) != packet->checksum;
+/* 截止时间是否已到；剩余不足一个时间单位也算到期，
+   否则浮点时间的舍入会让定时器在同一时刻反复触发 */
+int is_due(float deadline) {
+    return deadline >= 0 && deadline - time < 1.0;
 }
 
-/* 发送分组并启动定时器 */
-void send_packet(int seq_num) {
-    struct pkt packet;
-    packet.seqnum = seq_num;
-    packet.acknum = 0;
-    strncpy(packet.payload, send_buffer[seq_num].data, 20);
-    packet.checksum = compute_checksum(&packet);
-    
-    tolayer3(0, packet);
-    printf("发送分组: seq=%d\n", seq_num);
-    
-    /* 启动该分组的定时器 */
-    if (!acked[seq_num]) {
-        starttimer(0, TIMEOUT_INTERVAL);
-        timer_start[seq_num] = time; /* 记录发送时间 */
+/* 按窗口中的记录把第 seq 帧的消息装进 packet */
+void fill_frame(struct sr_entity *e, int seq, struct pkt *packet) {
+    int first = e->frame_first[seq % MAX_SEQ];
+    int count = e->frame_count[seq % MAX_SEQ];
+
+    packet->seqnum = seq % MAX_SEQ;
+    packet->length = count * MSG_SIZE;
+    for (int i = 0; i < count; i++) {
+        memcpy(packet->payload + i * MSG_SIZE, e->send_buffer[(first + i) % e->buffer_cap].data, MSG_SIZE);
+    }
+}
+
+/* 把从 msg_next 开始的 count 条消息记为第 seq 帧，并算好载荷的校验和 */
+void make_frame(struct sr_entity *e, int seq, int count) {
+    struct pkt frame;
+
+    e->frame_first[seq % MAX_SEQ] = e->msg_next;
+    e->frame_count[seq % MAX_SEQ] = count;
+    e->msg_next += count;
+    fill_frame(e, seq, &frame);
+    e->frame_sum[seq % MAX_SEQ] = pkt_payload_sum(&frame);
+}
+
+/* 取出一个待发送的ACK搭载在 packet 上 */
+void piggyback_ack(struct sr_entity *e, struct pkt *packet) {
+    packet->acknum = NO_ACK;
+    if (e->npending > 0) {
+        packet->acknum = e->pending_ack[--e->npending];
+        e->npiggyback++;
+        if (e->npending == 0) {
+            e->ack_deadline = -1;
+        }
     }
 }
 
-/* 发送ACK */
-void send_ack(int ack_num, int is_nak) {
+/* 发送分组并记录该分组的定时器开始时间，顺带搭载一个待发送的ACK */
+void send_packet(int AorB, int seq) {
+    struct sr_entity *e = &entity[AorB];
+    struct pkt packet;
+
+    fill_frame(e, seq, &packet);
+    piggyback_ack(e, &packet);
+    packet.checksum = pkt_checksum_finish(&packet, e->frame_sum[seq % MAX_SEQ]);
+
+    tolayer3(AorB, packet);
+    trace_printf("%s发送分组: seq=%d\n", entity_name(AorB), packet.seqnum);
+
+    e->ndata++;
+    e->timer_start[seq % MAX_SEQ] = time; /* 记录发送时间 */
+}
+
+/* 单独发送ACK或NAK */
+void send_ack(int AorB, int ack_num, int is_nak) {
     struct pkt ack_packet;
-    ack_packet.seqnum = 0;
+    ack_packet.seqnum = NO_DATA;
     ack_packet.acknum = ack_num;
     ack_packet.checksum = 0;
-    memset(ack_packet.payload, 0, 20);
-    
+    ack_packet.length = 0;
+    if (FEC) {
+        /* 带回接收方估计的丢失率（万分比），发送方据此调整 k */
+        int loss = (int)(entity[AorB].fec_rx->loss_est * 10000);
+        memcpy(ack_packet.payload, &loss, sizeof(int));
+        ack_packet.length = sizeof(int);
+    }
+
     /* 如果是NAK，设置特殊标记 */
     if (is_nak) {
         ack_packet.acknum = -ack_num - 1; /* 负值表示NAK */
     }
-    
-    ack_packet.checksum = compute_checksum(&ack_packet);
-    
-    tolayer3(1, ack_packet);
+
+    ack_packet.checksum = pkt_checksum(&ack_packet);
+
+    tolayer3(AorB, ack_packet);
     if (is_nak) {
-        printf("B发送NAK: seq=%d\n", ack_num);
+        trace_printf("%s发送NAK: seq=%d\n", entity_name(AorB), ack_num);
     } else {
-        printf("B发送ACK: seq=%d\n", ack_num);
+        trace_printf("%s发送ACK: seq=%d\n", entity_name(AorB), ack_num);
+        entity[AorB].nack++;
+    }
+}
+
+/* 新帧加入FEC组，组满时发送校验帧 */
+void send_parity(int AorB, int seq) {
+    struct sr_entity *e = &entity[AorB];
+    struct pkt frame, parity;
+
+    fill_frame(e, seq, &frame);
+    if (!fec_add(e->fec_tx, seq, &frame, &parity)) {
+        return;
+    }
+    piggyback_ack(e, &parity);
+    parity.checksum = pkt_checksum(&parity);
+
+    tolayer3(AorB, parity);
+    trace_printf("%s发送校验帧: seq=[%d, %d]\n", entity_name(AorB),
+           (seq - e->fec_tx->group_k + 1) % MAX_SEQ, seq % MAX_SEQ);
+}
+
+/* 发出所有待发送的ACK */
+void flush_acks(int AorB) {
+    struct sr_entity *e = &entity[AorB];
+
+    while (e->npending > 0) {
+        send_ack(AorB, e->pending_ack[--e->npending], 0);
+    }
+    e->ack_deadline = -1;
+}
+
+/* 记录一个待发送的ACK */
+void queue_ack(int AorB, int seq_num) {
+    struct sr_entity *e = &entity[AorB];
+
+    for (int i = 0; i < e->npending; i++) {
+        if (e->pending_ack[i] == seq_num) {
+            return;
+        }
+    }
+    e->pending_ack[e->npending++] = seq_num;
+    if (e->ack_deadline < 0) {
+        e->ack_deadline = time + ACK_HOLD;
     }
 }
 
-/* 检查序列号是否在发送窗口内 */
-int in_send_window(int seq_num) {
-    if (send_base <= seq_num && seq_num < send_base + WINDOW_SIZE) {
-        return 1;
+/* 把线路上的序号映射为 base 之后的绝对序号 */
+int unwrap_seq(int base, int wire_seq) {
+    return base + ((wire_seq - base % MAX_SEQ) % MAX_SEQ + MAX_SEQ) % MAX_SEQ;
+}
+
+/* 把缓存的消息组成帧，在窗口允许的范围内发送 */
+void send_window(int AorB) {
+    struct sr_entity *e = &entity[AorB];
+    int per_frame = mss / MSG_SIZE;
+
+    while (e->msg_next < e->buffer_end && e->next_seq < e->send_base + WINDOW_SIZE) {
+        int count = e->buffer_end - e->msg_next;
+        if (count > per_frame) {
+            count = per_frame;
+        }
+        /* Nagle：不满的帧等到没有未确认数据时再发 */
+        if (NAGLE && count < per_frame && e->send_base < e->next_seq) {
+            break;
+        }
+        make_frame(e, e->next_seq, count);
+        e->acked[e->next_seq % MAX_SEQ] = 0; /* 标记为未确认 */
+        send_packet(AorB, e->next_seq);
+        if (FEC) {
+            send_parity(AorB, e->next_seq);
+        }
+        e->next_seq++;
     }
-    if (send_base + WINDOW_SIZE >= MAX_SEQ && 
-        seq_num < (send_base + WINDOW_SIZE) % MAX_SEQ) {
-        return 1;
+}
+
+/* 发送缓冲加倍，未确认和未发送的消息按新的大小重新排放 */
+void grow_buffer(struct sr_entity *e) {
+    int cap = e->buffer_cap * 2;
+    struct msg *buffer = malloc(cap * sizeof(struct msg));
+
+    for (int i = e->msg_base; i < e->buffer_end; i++) {
+        buffer[i % cap] = e->send_buffer[i % e->buffer_cap];
     }
-    return 0;
+    free(e->send_buffer);
+    e->send_buffer = buffer;
+    e->buffer_cap = cap;
 }
 
-/* 检查序列号是否在接收窗口内 */
-int in_recv_window(int seq_num) {
-    if (recv_base <= seq_num && seq_num < recv_base + WINDOW_SIZE) {
-        return 1;
+/* 上层交给 AorB 的消息 */
+void entity_output(int AorB, struct msg message) {
+    struct sr_entity *e = &entity[AorB];
+
+    if (e->buffer_end - e->msg_base >= e->buffer_cap) {
+        if (e->buffer_cap >= BUFFER_SIZE) {
+            trace_printf("%s发送缓冲已满，丢弃上层消息\n", entity_name(AorB));
+            e->ndropped++;
+            layer5_dropped(AorB);
+            return;
+        }
+        grow_buffer(e);
     }
-    if (recv_base + WINDOW_SIZE >= MAX_SEQ && 
-        seq_num < (recv_base + WINDOW_SIZE) % MAX_SEQ) {
-        return 1;
+
+    /* 缓存消息，窗口有空闲则立即发送 */
+    e->send_buffer[e->buffer_end % e->buffer_cap] = message;
+    e->buffer_end++;
+    if (e->next_seq >= e->send_base + WINDOW_SIZE) {
+        trace_printf("窗口已满，消息 %d 被缓存\n", e->buffer_end - 1);
     }
-    return 0;
+    send_window(AorB);
+    arm_timer(AorB);
 }
 
-/* A_output - 发送方应用层调用 */
-void A_output(struct msg message) {
-    /* 缓存消息 */
-    int buffer_index = next_seq % MAX_SEQ;
-    send_buffer[buffer_index] = message;
-    
-    /* 如果窗口有空闲，立即发送 */
-    if (next_seq < send_base + WINDOW_SIZE) {
-        send_packet(next_seq);
-        acked[next_seq] = 0; /* 标记为未确认 */
-        next_seq = (next_seq + 1) % MAX_SEQ;
-    } else {
-        printf("窗口已满，分组 %d 被缓存\n", next_seq);
-        next_seq = (next_seq + 1) % MAX_SEQ;
+/* 收尾（-F）：发出的都已确认、缓冲里没有消息、也没有待发送的ACK */
+int entity_idle(int AorB) {
+    struct sr_entity *e = &entity[AorB];
+
+    return e->msg_base == e->buffer_end && e->npending == 0;
+}
+
+/* 时间序列（-T）：窗口内每个未确认的分组各有一个逻辑定时器 */
+int entity_metric(int AorB, int metric) {
+    struct sr_entity *e = &entity[AorB];
+    int nacked = 0;
+
+    for (int seq = e->send_base; seq < e->next_seq; seq++) {
+        nacked += e->acked[seq % MAX_SEQ];
+    }
+    switch (metric) {
+    case METRIC_INFLIGHT:
+        return e->next_seq - e->send_base;
+    case METRIC_ACKED:
+        return nacked;
+    case METRIC_RCVBUF:
+        return e->nbuffered;
+    case METRIC_SENDBUF:
+        return e->buffer_end - e->msg_next;
+    case METRIC_TIMERS:
+        return e->next_seq - e->send_base - nacked + (e->ack_deadline >= 0);
+    default:
+        return -1;
     }
 }
 
-/* A_input - 发送方网络层调用 */
-void A_input(struct pkt packet) {
-    if (is_corrupt(&packet)) {
-        printf("A收到损坏的ACK\n");
-        return;
+/* 检查点（-C/-R）：结构体整个写出，指针指向的发送缓冲和 FEC 状态另外写，恢复时重新分配 */
+void entity_checkpoint(int AorB, int restoring) {
+    struct sr_entity *e;
+
+    if (entity == NULL) {
+        entity = calloc(nentities, sizeof(struct sr_entity));
+    }
+    e = &entity[AorB];
+    checkpoint_data(e, sizeof(*e));
+    if (restoring) {
+        e->send_buffer = malloc(e->buffer_cap * sizeof(struct msg));
+        if (FEC) {
+            e->fec_tx = malloc(sizeof(struct fec_encoder));
+            e->fec_rx = malloc(sizeof(struct fec_decoder));
+        }
+    }
+    checkpoint_data(e->send_buffer, e->buffer_cap * sizeof(struct msg));
+    if (FEC) {
+        checkpoint_data(e->fec_tx, sizeof(struct fec_encoder));
+        checkpoint_data(e->fec_rx, sizeof(struct fec_decoder));
     }
-    
-    int ack_num = packet.acknum;
-    
-    /* 处理NAK (负值表示NAK) */
+}
+
+/* 饱和源（-S）：窗口有空位时才向上层要新消息，消息不会在发送缓冲里越积越多 */
+int entity_ready(int AorB) {
+    struct sr_entity *e = &entity[AorB];
+
+    return e->next_seq < e->send_base + WINDOW_SIZE;
+}
+
+/* 发送方处理收到的ACK/NAK */
+void sender_input(int AorB, int ack_num) {
+    struct sr_entity *e = &entity[AorB];
+
+    /* 处理NAK (负值表示NAK)：立即重传，不等超时 */
     if (ack_num < 0) {
         int nak_seq = -ack_num - 1;
-        printf("A收到NAK，重传分组: seq=%d\n", nak_seq);
-        if (in_send_window(nak_seq) && !acked[nak_seq]) {
-            send_packet(nak_seq);
+        int seq = unwrap_seq(e->send_base, nak_seq);
+        trace_printf("%s收到NAK，重传分组: seq=%d\n", entity_name(AorB), nak_seq);
+        if (seq < e->next_seq && !e->acked[nak_seq]) {
+            send_packet(AorB, seq);
+            e->nnak_retransmit++;
+            if (layer5_done(AorB)) {
+                e->ntail++;
+            }
         }
         return;
     }
-    
+
     /* 处理正常ACK */
-    printf("A收到ACK: seq=%d\n", ack_num);
-    
-    if (in_send_window(ack_num)) {
-        acked[ack_num] = 1; /* 标记为已确认 */
-        
+    trace_printf("%s收到ACK: seq=%d\n", entity_name(AorB), ack_num);
+
+    if (unwrap_seq(e->send_base, ack_num) < e->next_seq) {
+        e->acked[ack_num] = 1; /* 标记为已确认 */
+
         /* 移动窗口基序号到第一个未确认的分组 */
-        while (acked[send_base]) {
-            acked[send_base] = 0; /* 重置状态 */
-            send_base = (send_base + 1) % MAX_SEQ;
-            printf("发送窗口移动到: base=%d\n", send_base);
+        while (e->send_base < e->next_seq && e->acked[e->send_base % MAX_SEQ]) {
+            e->msg_base = e->frame_first[e->send_base % MAX_SEQ] + e->frame_count[e->send_base % MAX_SEQ];
+            e->send_base++;
+            trace_printf("发送窗口移动到: base=%d\n", e->send_base % MAX_SEQ);
         }
-        
-        /* 停止定时器如果没有未确认的分组 */
-        int has_unacked = 0;
-        for (int i = 0; i < WINDOW_SIZE; i++) {
-            int seq = (send_base + i) % MAX_SEQ;
-            if (seq < next_seq && !acked[seq]) {
-                has_unacked = 1;
-                break;
-            }
+        send_window(AorB);
+    }
+}
+
+/* 对接收窗口中最高已缓存分组之下的空洞发送NAK，每个空洞按 NAK_INTERVAL 限速 */
+void send_gap_naks(int AorB) {
+    struct sr_entity *e = &entity[AorB];
+    int highest = -1;
+
+    for (int i = WINDOW_SIZE - 1; i > 0; i--) {
+        if (e->received[(e->recv_base + i) % MAX_SEQ]) {
+            highest = e->recv_base + i;
+            break;
+        }
+    }
+
+    for (int seq = e->recv_base; seq < highest; seq++) {
+        int slot = seq % MAX_SEQ;
+        if (e->received[slot]) {
+            continue;
         }
-        
-        if (!has_unacked) {
-            stoptimer(0);
+        if (e->nak_time[slot] < 0 || time - e->nak_time[slot] >= NAK_INTERVAL) {
+            send_ack(AorB, slot, 1);
+            e->nak_time[slot] = time;
+            e->nnak++;
         }
     }
 }
 
-/* A_timerinterrupt - 发送方超时处理 */
-void A_timerinterrupt() {
-    printf("超时，检查未确认的分组\n");
-    
-    /* 检查所有在窗口中且未确认的分组 */
-    for (int i = 0; i < WINDOW_SIZE; i++) {
-        int seq = (send_base + i) % MAX_SEQ;
-        if (seq < next_seq && !acked[seq]) {
-            /* 检查是否真的超时 */
-            if (time - timer_start[seq] > TIMEOUT_INTERVAL) {
-                printf("重传超时分组: seq=%d\n", seq);
-                send_packet(seq);
+/* 接收方处理收到的数据分组 */
+void receiver_input(int AorB, struct pkt *packet) {
+    struct sr_entity *e = &entity[AorB];
+    int seq_num = packet->seqnum;
+    int seq = unwrap_seq(e->recv_base, seq_num);
+
+    trace_printf("%s收到分组: seq=%d, 期望=%d\n", entity_name(AorB), seq_num, e->recv_base % MAX_SEQ);
+
+    /* 不在接收窗口内的只能是已交付分组的重传（其ACK丢失），重发ACK即可 */
+    e->ndata_in++;
+    if (seq >= e->recv_base + WINDOW_SIZE) {
+        trace_printf("%s收到已交付的分组: seq=%d, 重发ACK\n", entity_name(AorB), seq_num);
+        e->nduplicate++;
+        queue_ack(AorB, seq_num);
+        return;
+    }
+
+    if (FEC) {
+        fec_store(e->fec_rx, seq, packet);
+    }
+
+    if (!e->received[seq_num]) {
+        /* 缓存分组 */
+        e->recv_buffer[seq_num] = *packet;
+        e->received[seq_num] = 1;
+        e->arrive_time[seq_num] = time;
+        e->nbuffered++;
+        trace_printf("%s缓存分组: seq=%d\n", entity_name(AorB), seq_num);
+    } else {
+        e->nduplicate++;
+    }
+
+    /* 该分组的ACK */
+    queue_ack(AorB, seq_num);
+
+    /* 检查是否可以交付数据 */
+    while (e->received[e->recv_base % MAX_SEQ]) {
+        int slot = e->recv_base % MAX_SEQ;
+
+        /* 拆开帧逐条交付到应用层 */
+        for (int i = 0; i + MSG_SIZE <= e->recv_buffer[slot].length; i += MSG_SIZE) {
+            tolayer5(AorB, e->recv_buffer[slot].payload + i);
+        }
+        trace_printf("%s交付分组: seq=%d\n", entity_name(AorB), slot);
+        if (time > e->arrive_time[slot]) {
+            e->nhol++;
+            e->hol_time += time - e->arrive_time[slot];
+            if (time - e->arrive_time[slot] > e->hol_max) {
+                e->hol_max = time - e->arrive_time[slot];
             }
         }
+
+        e->received[slot] = 0; /* 重置状态 */
+        e->nbuffered--;
+        e->nak_time[slot] = -1;
+        e->recv_base++;
+    }
+
+    /* 交付之后还留在缓冲里的，都是在等前面空洞的乱序分组 */
+    e->buffered_sum += e->nbuffered;
+    if (e->nbuffered > e->buffered_max) {
+        e->buffered_max = e->nbuffered;
+    }
+
+    if (GAP_NAK) {
+        send_gap_naks(AorB);
+    }
+}
+
+/* 头部的序号都在合法范围内：seqnum 为 [0, MAX_SEQ)、NO_DATA 或 FEC_PARITY，
+   acknum 为 [0, MAX_SEQ) 的ACK、[-MAX_SEQ, 0) 的NAK 或 NO_ACK。
+   两个字段都直接作窗口数组的下标，校验和漏掉的差错不能让它们越界 */
+int header_in_range(const struct pkt *packet) {
+    int seq = packet->seqnum, ack = packet->acknum;
+
+    if ((seq < 0 || seq >= MAX_SEQ) && seq != NO_DATA && seq != FEC_PARITY) {
+        return 0;
     }
-    
-    /* 重启定时器 */
-    starttimer(0, TIMEOUT_INTERVAL);
+    return ack >= -MAX_SEQ && ack <= NO_ACK;
 }
 
-/* B_input - 接收方网络层调用 */
-void B_input(struct pkt packet) {
-    if (is_corrupt(&packet)) {
-        printf("B收到损坏的分组\n");
+/* 处理到达 AorB 的分组：先作为接收方处理数据，再作为发送方处理ACK，
+   这样因ACK而滑出的新分组可以搭载刚产生的ACK */
+void entity_input(int AorB, struct pkt packet) {
+    if (pkt_is_corrupt(&packet) || !header_in_range(&packet)) {
+        trace_printf("%s收到损坏的分组\n", entity_name(AorB));
         return;
     }
-    
-    int seq_num = packet.seqnum;
-    printf("B收到分组: seq=%d, 期望=%d\n", seq_num, recv_base);
-    
-    /* 检查是否在接收窗口内 */
-    if (in_recv_window(seq_num)) {
-        if (!received[seq_num]) {
-            /* 缓存分组 */
-            strncpy(recv_buffer[seq_num].data, packet.payload, 20);
-            received[seq_num] = 1;
-            printf("B缓存分组: seq=%d\n", seq_num);
-        }
-        
-        /* 发送该分组的ACK */
-        send_ack(seq_num, 0);
-        
-        /* 检查是否可以交付数据 */
-        while (received[recv_base]) {
-            /* 交付到应用层 */
-            tolayer5(1, recv_buffer[recv_base].data);
-            printf("B交付分组: seq=%d\n", recv_base);
-            
-            received[recv_base] = 0; /* 重置状态 */
-            recv_base = (recv_base + 1) % MAX_SEQ;
+
+    if (packet.seqnum == FEC_PARITY) {
+        struct pkt recovered;
+        int seq = fec_recover(entity[AorB].fec_rx, &packet, &recovered);
+        if (seq >= 0) {
+            trace_printf("%s用校验帧还原分组: seq=%d\n", entity_name(AorB), seq % MAX_SEQ);
+            recovered.seqnum = seq % MAX_SEQ;
+            receiver_input(AorB, &recovered);
         }
-    } else {
-        /* 分组不在窗口内，发送NAK请求重传 */
-        printf("B收到窗口外分组: seq=%d, 发送NAK\n", seq_num);
-        send_ack(seq_num, 1);
+    } else if (packet.seqnum != NO_DATA) {
+        receiver_input(AorB, &packet);
+    } else if (FEC && packet.length >= (int)sizeof(int)) {
+        int loss;
+        memcpy(&loss, packet.payload, sizeof(int));
+        fec_set_loss(entity[AorB].fec_tx, loss / 10000.0);
+    }
+    if (packet.acknum != NO_ACK) {
+        sender_input(AorB, packet.acknum);
     }
+    if (!PIGGYBACK) {
+        flush_acks(AorB);
+    }
+    arm_timer(AorB);
 }
 
-/* B_timerinterrupt - 接收方定时器（可选，用于清理等） */
-void B_timerinterrupt() {
-    /* SR接收方通常不需要定时器，但可以用于其他维护任务 */
-    starttimer(1, 1000.0); /* 简单的保持定时器 */
-}
+/* 定时器到期：重传到期的分组，发出等不到反向数据的ACK */
+void entity_timerinterrupt(int AorB) {
+    struct sr_entity *e = &entity[AorB];
+
+    e->timer_running = 0;
+
+    /* 检查所有在窗口中且未确认的分组 */
+    for (int seq = e->send_base; seq < e->next_seq; seq++) {
+        if (!e->acked[seq % MAX_SEQ] && is_due(e->timer_start[seq % MAX_SEQ] + TIMEOUT_INTERVAL)) {
+            trace_printf("%s重传超时分组: seq=%d\n", entity_name(AorB), seq % MAX_SEQ);
+            send_packet(AorB, seq);
+            e->nretransmit++;
+            if (layer5_done(AorB)) {
+                e->ntail++;
+            }
+        }
+    }
+
+    if (is_due(e->ack_deadline)) {
+        flush_acks(AorB);
+    }
 
-/* B_output - 双向传输时使用 */
-void B_output(struct msg message) {
-    /* 对于单向传输，这个函数不会被调用 */
-    printf("B_output called - not used in unidirectional transfer\n");
+    arm_timer(AorB);
 }
 
-/* 初始化函数 */
-void A_init() {
-    send_base = 0;
-    next_seq = 0;
-    memset(acked, 0, sizeof(acked));
-    memset(timer_start, 0, sizeof(timer_start));
-    printf("A初始化完成 - SR协议，窗口大小=%d\n", WINDOW_SIZE);
+void entity_init(int AorB) {
+    struct sr_entity *e;
+
+    if (entity == NULL) {
+        entity = calloc(nentities, sizeof(struct sr_entity));
+    }
+    e = &entity[AorB];
+    memset(e, 0, sizeof(*e));
+    e->buffer_cap = BUFFER_INIT;
+    e->send_buffer = malloc(BUFFER_INIT * sizeof(struct msg));
+    if (FEC) {
+        e->fec_tx = malloc(sizeof(struct fec_encoder));
+        e->fec_rx = malloc(sizeof(struct fec_decoder));
+        fec_encoder_init(e->fec_tx, WINDOW_SIZE - 1);
+        fec_decoder_init(e->fec_rx);
+    }
+    for (int i = 0; i < MAX_SEQ; i++) {
+        e->nak_time[i] = -1;
+    }
+    e->ack_deadline = -1;
+    trace_printf("%s初始化完成 - SR协议，窗口大小=%d\n", entity_name(AorB), WINDOW_SIZE);
 }
 
-void B_init() {
-    recv_base = 0;
-    memset(received, 0, sizeof(received));
-    printf("B初始化完成 - SR协议，窗口大小=%d\n", WINDOW_SIZE);
+/* 运行结束时由模拟器调用，打印协议统计；多条流时按 A、B 两侧汇总 */
+void protocol_stats() {
+    for (int side = 0; side < 2; side++) {
+        struct sr_entity sum;
+        int nparity = 0, nrecovered = 0;
+        char name[32];
+
+        memset(&sum, 0, sizeof(sum));
+        for (int id = side; id < nentities; id += 2) {
+            struct sr_entity *e = &entity[id];
+            sum.ndata += e->ndata;
+            sum.nretransmit += e->nretransmit;
+            sum.nnak_retransmit += e->nnak_retransmit;
+            sum.ntail += e->ntail;
+            sum.ndropped += e->ndropped;
+            sum.nnak += e->nnak;
+            sum.nack += e->nack;
+            sum.npiggyback += e->npiggyback;
+            sum.nduplicate += e->nduplicate;
+            sum.buffered_sum += e->buffered_sum;
+            if (e->buffered_max > sum.buffered_max) {
+                sum.buffered_max = e->buffered_max;
+            }
+            sum.ndata_in += e->ndata_in;
+            sum.nhol += e->nhol;
+            sum.hol_time += e->hol_time;
+            if (e->hol_max > sum.hol_max) {
+                sum.hol_max = e->hol_max;
+            }
+            if (FEC) {
+                nparity += e->fec_tx->nparity;
+                nrecovered += e->fec_rx->nrecovered;
+            }
+        }
+
+        if (nflows == 1) {
+            sprintf(name, "%c", 'A' + side);
+        } else {
+            sprintf(name, "%c, %d flows", 'A' + side, nflows);
+        }
+        printf(" SR %s: data pkts: %d, timeout retransmissions: %d, NAK retransmissions: %d, "
+               "NAKs sent: %d\n", name, sum.ndata, sum.nretransmit, sum.nnak_retransmit, sum.nnak);
+        printf(" SR %s: standalone ACKs: %d, piggybacked ACKs: %d\n", name, sum.nack, sum.npiggyback);
+        if (sum.ntail > 0) {
+            printf(" SR %s: retransmissions after the last msg: %d\n", name, sum.ntail);
+        }
+        if (sum.ndropped > 0) {
+            printf(" SR %s: msgs dropped with the send buffer full: %d\n", name, sum.ndropped);
+        }
+        if (FEC && nflows == 1) {
+            printf(" SR %s: parity pkts: %d, recovered without retransmission: %d, k: %d, "
+                   "loss estimate at the receiver: %f\n", name, nparity, nrecovered,
+                   entity[side].fec_tx->k, entity[side ^ 1].fec_rx->loss_est);
+        } else if (FEC) {
+            printf(" SR %s: parity pkts: %d, recovered without retransmission: %d\n",
+                   name, nparity, nrecovered);
+        }
+        if (sum.ndata_in > 0) {
+            printf(" SR %s: data pkts received: %d, duplicates: %d, receive buffer: mean %.2f, max %d\n",
+                   name, sum.ndata_in, sum.nduplicate, (double)sum.buffered_sum / sum.ndata_in,
+                   sum.buffered_max);
+        }
+        printf(" SR %s: head-of-line blocked pkts: %d, total blocked time: %f", name, sum.nhol, sum.hol_time);
+        if (sum.nhol > 0) {
+            printf(", mean: %f, max: %f", sum.hol_time / sum.nhol, sum.hol_max);
+        }
+        printf("\n");
+    }
 }
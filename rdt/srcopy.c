@@ -0,0 +1,695 @@
+#define _GNU_SOURCE /* sendmmsg, recvmmsg */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "checksum.h"
+#include "udpio.h"
+
+/**
+ * 基于 SR 的可靠文件传输，走 UDP：
+ *   ./srcopy.out recv [-l 丢失率] [-s 种子] 端口 输出文件
+ *   ./srcopy.out send [-l 丢失率] [-s 种子] [-m 段大小] [-w 窗口] [-t 超时毫秒] 地址 端口 输入文件
+ *   ./srcopy.out bench [同上的选项] 输入文件 输出文件     （本机上 fork 出接收方，报告 GB/s）
+ *
+ * 协议沿用 sr.c 的选择重传：每一段各自确认、各自计时，只重传没确认的段，
+ * 接收方保存乱序到达的段。为了大文件改了几处：
+ *   - 段是 -m 字节（默认 1400）的文件片段，不再是 20 字节的消息；窗口是上千段（默认 4096）
+ *   - 发送方 mmap 源文件，每个数据报用两段 iovec（头部 + 映射里的片段）直接发出，不复制
+ *   - 两边都用 sendmmsg/recvmmsg 批量收发，每次最多 BATCH 个数据报
+ *   - 接收方用 posix_fallocate 预分配输出文件并 mmap，每段直接写到它在文件里的位置，
+ *     乱序的段不另外缓存，接收方的状态只是整个文件的一张位图
+ *   - 接收方每收完一批回一个ACK：累计确认号加后面 SACK_BITS 段的位图，相当于把 sr.c
+ *     逐个分组的ACK合并起来；位图里出现空洞时发送方过 -t/4 就重传空洞（类似 sr.c 的 NAK），
+ *     否则等 -t 超时
+ *   - 头部和载荷用 CRC32C 校验（checksum.c，有 crc32 指令时用指令）
+ * -l 在各自的发送路径上按概率丢弃数据报（发送方丢数据段，接收方丢ACK），模拟有损链路。
+ * 头部按网络字节序。
+ */
+
+#define DEFAULT_MSS 1400
+#define MAX_MSS_BYTES 65000
+#define DEFAULT_WINDOW 4096
+#define MAX_WINDOW 65536
+#define DEFAULT_RTO_MS 20.0
+#define INITIAL_RTO 1.0    /* 还没有RTT样本时的超时秒数（RFC 6298） */
+#define BATCH 64
+#define SACK_BITS 4096
+#define SCAN_INTERVAL 0.001 /* 两次检查超时之间至少间隔的秒数 */
+#define LINGER 0.2          /* 接收方收齐后继续应答重传的秒数，防止最后的ACK丢失 */
+#define IDLE_TIMEOUT 10.0   /* 这么久没有任何数据报就放弃 */
+
+enum { SEG_DATA = 1, SEG_ACK = 2 };
+
+/* 线路上的头部，32 字节 */
+struct seg_header {
+    uint32_t type;
+    uint32_t seq;  /* DATA：段号；ACK：累计确认，之前的段都已收到 */
+    uint32_t len;  /* DATA：载荷字节数；ACK：位图字节数 */
+    uint32_t crc;  /* crc 为 0 时头部加载荷的 CRC32C */
+    uint32_t size_hi, size_lo; /* 文件大小，接收方据此预分配 */
+    uint32_t mss;  /* 段大小，接收方据此计算偏移 */
+    uint32_t pad;
+};
+
+struct options {
+    double loss;
+    unsigned long long seed;
+    int mss, window;
+    double rto;
+};
+
+/* 一端的统计，bench 模式下接收方通过管道交回父进程 */
+struct stats {
+    long nsegs, ndata, nretransmit, ndropped, nack, ncorrupt, nduplicate;
+    unsigned long nsyscalls;
+    double cpu;
+};
+
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static double rng_uniform(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+/* ========== 头部 ========== */
+
+static void header_to_wire(struct seg_header *h) {
+    uint32_t *w = (uint32_t *)h;
+    for (int i = 0; i < 8; i++) {
+        w[i] = htonl(w[i]);
+    }
+}
+
+static void header_from_wire(struct seg_header *h) {
+    uint32_t *w = (uint32_t *)h;
+    for (int i = 0; i < 8; i++) {
+        w[i] = ntohl(w[i]);
+    }
+}
+
+/* 线路格式的头部（crc 字段为 0）加载荷 */
+static uint32_t seg_crc(const struct seg_header *wire, const void *payload, int len) {
+    return ~crc32c_update(crc32c_update(0xFFFFFFFF, wire, sizeof(*wire)), payload, len);
+}
+
+/* ========== 套接字 ========== */
+
+static int open_socket(const char *host, int port) {
+    struct sockaddr_in addr;
+    int size = 8 * 1024 * 1024;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (fd < 0) {
+        die("socket");
+    }
+    /* 普通用户的 SO_RCVBUF 受 net.core.rmem_max 限制，有权限时用 FORCE 绕过 */
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    if (setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE, &size, sizeof(size)) < 0) {
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "srcopy: bad address %s\n", host);
+        exit(1);
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        die("bind");
+    }
+    return fd;
+}
+
+static void connect_to(int fd, const struct sockaddr_in *addr) {
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+        die("connect");
+    }
+}
+
+/* 等 fd 可读，最多 seconds 秒；返回是否可读 */
+static int wait_readable(int fd, double seconds) {
+    struct pollfd p = {fd, POLLIN, 0};
+    int n;
+
+    udpio_nsyscalls++;
+    do {
+        n = poll(&p, 1, (int)(seconds * 1000) + 1);
+    } while (n < 0 && errno == EINTR);
+    return n > 0;
+}
+
+/* ========== 发送方 ========== */
+
+struct sender {
+    int fd;
+    const unsigned char *data; /* mmap 的源文件 */
+    uint64_t size;
+    int mss, window;
+    long nsegs, base, next, highest_sacked;
+    double *sent_at;           /* 按 seq % window 存放，每段上次发送的时间 */
+    unsigned char *acked;
+    unsigned char *resent;     /* 重传过的段不用来估计RTT（Karn） */
+    double srtt, rttvar;       /* 平滑RTT和偏差，秒，0 表示还没有样本 */
+    struct seg_header hdr[BATCH];
+    struct iovec iov[BATCH][2];
+    struct mmsghdr msgs[BATCH];
+    int nbatch;
+    struct stats st;
+};
+
+static int seg_len(const struct sender *s, long seq) {
+    uint64_t off = (uint64_t)seq * s->mss;
+    return off + s->mss <= s->size ? s->mss : (int)(s->size - off);
+}
+
+static void flush(struct sender *s) {
+    int done = 0;
+
+    while (done < s->nbatch) {
+        udpio_nsyscalls++;
+        int n = sendmmsg(s->fd, s->msgs + done, s->nbatch - done, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ECONNREFUSED) {
+                break; /* 接收方还没开始或已经退出，靠重传 */
+            }
+            die("sendmmsg");
+        }
+        done += n;
+    }
+    s->nbatch = 0;
+}
+
+/* 把第 seq 段放进这一批，头部在批内缓存，载荷直接指向映射 */
+static void queue_segment(struct sender *s, long seq, double now, const struct options *opt) {
+    struct seg_header *h = &s->hdr[s->nbatch];
+    int len = seg_len(s, seq);
+    const unsigned char *payload = s->data + (uint64_t)seq * s->mss;
+
+    s->resent[seq % s->window] = s->sent_at[seq % s->window] > 0;
+    s->sent_at[seq % s->window] = now;
+    s->st.ndata++;
+    if (opt->loss > 0 && rng_uniform() < opt->loss) {
+        s->st.ndropped++;
+        return;
+    }
+    memset(h, 0, sizeof(*h));
+    h->type = SEG_DATA;
+    h->seq = (uint32_t)seq;
+    h->len = (uint32_t)len;
+    h->size_hi = (uint32_t)(s->size >> 32);
+    h->size_lo = (uint32_t)s->size;
+    h->mss = (uint32_t)s->mss;
+    header_to_wire(h);
+    h->crc = htonl(seg_crc(h, payload, len));
+    s->iov[s->nbatch][0].iov_base = h;
+    s->iov[s->nbatch][0].iov_len = sizeof(*h);
+    s->iov[s->nbatch][1].iov_base = (void *)payload;
+    s->iov[s->nbatch][1].iov_len = len;
+    memset(&s->msgs[s->nbatch], 0, sizeof(s->msgs[0]));
+    s->msgs[s->nbatch].msg_hdr.msg_iov = s->iov[s->nbatch];
+    s->msgs[s->nbatch].msg_hdr.msg_iovlen = 2;
+    if (++s->nbatch == BATCH) {
+        flush(s);
+    }
+}
+
+/* 新确认的段：没重传过就用它的往返时间更新估计（RFC 6298 的系数） */
+static void segment_acked(struct sender *s, long seq, double now, double *sample) {
+    s->acked[seq % s->window] = 1;
+    if (!s->resent[seq % s->window]) {
+        *sample = now - s->sent_at[seq % s->window];
+    }
+}
+
+static void rtt_update(struct sender *s, double sample) {
+    if (s->srtt == 0) {
+        s->srtt = sample;
+        s->rttvar = sample / 2;
+    } else {
+        s->rttvar = 0.75 * s->rttvar + 0.25 * fabs(s->srtt - sample);
+        s->srtt = 0.875 * s->srtt + 0.125 * sample;
+    }
+}
+
+/* 累计确认之前的段都已收到，位图的第 i 位是 cum+1+i 段 */
+static void handle_ack(struct sender *s, unsigned char *buf, int n, double now) {
+    struct seg_header h;
+    const unsigned char *bitmap = buf + sizeof(h);
+    double sample = -1;
+    long cum;
+
+    if (n < (int)sizeof(h)) {
+        return;
+    }
+    memcpy(&h, buf, sizeof(h));
+    uint32_t crc = ntohl(h.crc);
+    ((struct seg_header *)buf)->crc = 0;
+    header_from_wire(&h);
+    if (h.type != SEG_ACK || (int)h.len > n - (int)sizeof(h) ||
+        seg_crc((struct seg_header *)buf, bitmap, h.len) != crc) {
+        s->st.ncorrupt += h.type == SEG_ACK;
+        return;
+    }
+    s->st.nack++;
+    cum = h.seq;
+    for (long seq = s->base; seq < cum && seq < s->next; seq++) {
+        if (!s->acked[seq % s->window]) {
+            segment_acked(s, seq, now, &sample);
+        }
+    }
+    for (long i = 0; i < (long)h.len * 8; i++) {
+        long seq = cum + 1 + i;
+        if (seq >= s->next) {
+            break;
+        }
+        if (seq >= s->base && (bitmap[i / 8] >> (i % 8) & 1)) {
+            if (!s->acked[seq % s->window]) {
+                segment_acked(s, seq, now, &sample);
+            }
+            if (seq > s->highest_sacked) {
+                s->highest_sacked = seq;
+            }
+        }
+    }
+    if (sample >= 0) {
+        rtt_update(s, sample);
+    }
+    while (s->base < s->next && s->acked[s->base % s->window]) {
+        s->base++;
+    }
+}
+
+/* 超时的段和位图里空洞的段重传。超时取 -t 和 srtt + 4*rttvar 中大的，还没有RTT样本
+ * 时按 1 s 算；空洞至少等 -t/4 和 srtt + 2*rttvar，已经重传过的空洞等两倍，免得
+ * 前一份还在队列里就又发一份。
+ * 本机上两端抢一个 CPU 时排队时延可能比 -t 还长，固定的超时会把还在队列里的段当成丢了 */
+static void retransmit(struct sender *s, double now, const struct options *opt) {
+    double rto = s->srtt == 0 ? INITIAL_RTO : fmax(opt->rto / 1000, s->srtt + 4 * s->rttvar);
+    double hole = fmax(opt->rto / 4000, s->srtt + 2 * s->rttvar);
+
+    for (long seq = s->base; seq < s->next; seq++) {
+        if (s->acked[seq % s->window]) {
+            continue;
+        }
+        double idle = now - s->sent_at[seq % s->window];
+        if (idle > rto ||
+            (seq < s->highest_sacked && idle > hole * (1 + s->resent[seq % s->window]))) {
+            s->st.nretransmit++;
+            queue_segment(s, seq, now, opt);
+        }
+    }
+}
+
+static struct stats run_sender(int fd, const char *file, const struct options *opt) {
+    struct sender s;
+    struct stat sb;
+    unsigned char ack[BATCH][sizeof(struct seg_header) + SACK_BITS / 8];
+    struct iovec ack_iov[BATCH];
+    struct mmsghdr ack_msgs[BATCH];
+    double last_scan = 0, last_ack;
+    int in = open(file, O_RDONLY);
+
+    memset(&s, 0, sizeof(s));
+    if (in < 0 || fstat(in, &sb) < 0) {
+        die(file);
+    }
+    s.fd = fd;
+    s.size = sb.st_size;
+    s.mss = opt->mss;
+    s.window = opt->window;
+    s.nsegs = s.size ? (long)((s.size + s.mss - 1) / s.mss) : 1; /* 空文件也发一段，告诉接收方大小 */
+    s.highest_sacked = -1;
+    if (s.size > 0) {
+        s.data = mmap(NULL, s.size, PROT_READ, MAP_PRIVATE, in, 0);
+        if (s.data == MAP_FAILED) {
+            die("mmap");
+        }
+        madvise((void *)s.data, s.size, MADV_SEQUENTIAL);
+    }
+    s.sent_at = calloc(s.window, sizeof(double));
+    s.acked = calloc(s.window, 1);
+    s.resent = calloc(s.window, 1);
+    for (int i = 0; i < BATCH; i++) {
+        ack_iov[i].iov_base = ack[i];
+        ack_iov[i].iov_len = sizeof(ack[i]);
+        memset(&ack_msgs[i], 0, sizeof(ack_msgs[i]));
+        ack_msgs[i].msg_hdr.msg_iov = &ack_iov[i];
+        ack_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    last_ack = udpio_clock();
+    while (s.base < s.nsegs) {
+        double now = udpio_clock();
+        if (now - last_scan >= SCAN_INTERVAL) {
+            retransmit(&s, now, opt);
+            last_scan = now;
+        }
+        /* 新段，每轮最多几批，之后先看ACK */
+        for (int k = 0; k < 4 * BATCH && s.next < s.nsegs && s.next < s.base + s.window; k++) {
+            s.acked[s.next % s.window] = 0;
+            s.sent_at[s.next % s.window] = 0; /* 槽位换了新段，不算重传 */
+            queue_segment(&s, s.next++, now, opt);
+        }
+        flush(&s);
+
+        udpio_nsyscalls++;
+        int n = recvmmsg(fd, ack_msgs, BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED &&
+                errno != EINTR) {
+                die("recvmmsg");
+            }
+            /* 窗口满了或者都发完了，等ACK或下一次超时检查 */
+            if (s.next == s.nsegs || s.next == s.base + s.window) {
+                if (!wait_readable(fd, SCAN_INTERVAL) && udpio_clock() - last_ack > IDLE_TIMEOUT) {
+                    fprintf(stderr, "srcopy: no ACK for %.0f s, giving up\n", IDLE_TIMEOUT);
+                    exit(1);
+                }
+            }
+            continue;
+        }
+        last_ack = udpio_clock();
+        for (int i = 0; i < n; i++) {
+            handle_ack(&s, ack[i], ack_msgs[i].msg_len, last_ack);
+        }
+    }
+
+    s.st.nsegs = s.nsegs;
+    if (s.size > 0) {
+        munmap((void *)s.data, s.size);
+    }
+    close(in);
+    free(s.sent_at);
+    free(s.acked);
+    free(s.resent);
+    return s.st;
+}
+
+/* ========== 接收方 ========== */
+
+static void send_ack(int fd, long cum, const unsigned char *received, long nsegs, const struct options *opt,
+                     struct stats *st) {
+    unsigned char buf[sizeof(struct seg_header) + SACK_BITS / 8];
+    struct seg_header *h = (struct seg_header *)buf;
+    unsigned char *bitmap = buf + sizeof(*h);
+
+    st->nack++;
+    if (opt->loss > 0 && rng_uniform() < opt->loss) {
+        st->ndropped++;
+        return;
+    }
+    memset(buf, 0, sizeof(buf));
+    for (long i = 0; i < SACK_BITS && cum + 1 + i < nsegs; i++) {
+        long seq = cum + 1 + i;
+        if (received[seq / 8] >> (seq % 8) & 1) {
+            bitmap[i / 8] |= 1 << (i % 8);
+        }
+    }
+    h->type = SEG_ACK;
+    h->seq = (uint32_t)cum;
+    h->len = SACK_BITS / 8;
+    header_to_wire(h);
+    h->crc = htonl(seg_crc(h, bitmap, SACK_BITS / 8));
+    udpio_nsyscalls++;
+    if (send(fd, buf, sizeof(buf), 0) < 0 && errno != ECONNREFUSED) {
+        die("send");
+    }
+}
+
+static struct stats run_receiver(int fd, const char *file, const struct options *opt) {
+    static unsigned char bufs[BATCH][sizeof(struct seg_header) + MAX_MSS_BYTES];
+    struct iovec iov[BATCH];
+    struct mmsghdr msgs[BATCH];
+    struct sockaddr_in peers[BATCH];
+    unsigned char *out = NULL, *received = NULL;
+    uint64_t size = 0;
+    long nsegs = -1, base = 0;
+    int connected = 0, outfd = -1;
+    double done_at = 0, last_data = udpio_clock();
+    struct stats st;
+
+    memset(&st, 0, sizeof(st));
+    for (int i = 0; i < BATCH; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = sizeof(bufs[i]);
+    }
+
+    for (;;) {
+        double now = udpio_clock();
+        if (done_at > 0 && now - done_at > LINGER) {
+            break;
+        }
+        if (!wait_readable(fd, done_at > 0 ? LINGER : 1.0)) {
+            if (done_at == 0 && now - last_data > IDLE_TIMEOUT && nsegs >= 0) {
+                fprintf(stderr, "srcopy: no data for %.0f s, giving up\n", IDLE_TIMEOUT);
+                exit(1);
+            }
+            continue;
+        }
+        for (int i = 0; i < BATCH; i++) {
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &peers[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(peers[i]);
+        }
+        udpio_nsyscalls++;
+        int n = recvmmsg(fd, msgs, BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) {
+            continue;
+        }
+        last_data = udpio_clock();
+        for (int i = 0; i < n; i++) {
+            struct seg_header h;
+            unsigned char *payload = bufs[i] + sizeof(h);
+            int len = (int)msgs[i].msg_len - (int)sizeof(h);
+
+            if (len < 0) {
+                continue;
+            }
+            memcpy(&h, bufs[i], sizeof(h));
+            uint32_t crc = ntohl(h.crc);
+            ((struct seg_header *)bufs[i])->crc = 0;
+            header_from_wire(&h);
+            if (h.type != SEG_DATA || (int)h.len != len || seg_crc((struct seg_header *)bufs[i], payload, len) != crc) {
+                st.ncorrupt++;
+                continue;
+            }
+            if (!connected) {
+                /* 第一个数据段：记下发送方，预分配并映射输出文件 */
+                connect_to(fd, &peers[i]);
+                connected = 1;
+                size = (uint64_t)h.size_hi << 32 | h.size_lo;
+                nsegs = size ? (long)((size + h.mss - 1) / h.mss) : 1;
+                received = calloc((nsegs + 7) / 8, 1);
+                outfd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+                if (outfd < 0) {
+                    die(file);
+                }
+                if (size > 0) {
+                    int err = posix_fallocate(outfd, 0, size);
+                    if (err != 0 && ftruncate(outfd, size) < 0) {
+                        die("ftruncate");
+                    }
+                    out = mmap(NULL, size, PROT_WRITE, MAP_SHARED, outfd, 0);
+                    if (out == MAP_FAILED) {
+                        die("mmap");
+                    }
+                }
+            }
+            long seq = h.seq;
+            if (seq >= nsegs || (uint64_t)seq * h.mss + len > size + (size == 0)) {
+                st.ncorrupt++;
+                continue;
+            }
+            if (received[seq / 8] >> (seq % 8) & 1) {
+                st.nduplicate++;
+                continue;
+            }
+            if (len > 0) {
+                memcpy(out + (uint64_t)seq * h.mss, payload, len);
+            }
+            received[seq / 8] |= 1 << (seq % 8);
+            st.ndata++;
+            while (base < nsegs && (received[base / 8] >> (base % 8) & 1)) {
+                base++;
+            }
+        }
+        if (connected) {
+            send_ack(fd, base, received, nsegs, opt, &st);
+            if (base == nsegs && done_at == 0) {
+                done_at = udpio_clock();
+            }
+        }
+    }
+
+    st.nsegs = nsegs;
+    if (out != NULL) {
+        munmap(out, size);
+    }
+    if (outfd >= 0) {
+        close(outfd);
+    }
+    free(received);
+    return st;
+}
+
+/* ========== 命令行 ========== */
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: srcopy.out recv [-l loss] [-s seed] port outfile\n"
+            "       srcopy.out send [-l loss] [-s seed] [-m mss] [-w window] [-t rto_ms] host port infile\n"
+            "       srcopy.out bench [-l loss] [-s seed] [-m mss] [-w window] [-t rto_ms] infile outfile\n");
+    exit(1);
+}
+
+static void print_stats(const char *who, const struct stats *st) {
+    printf(" %s: segments: %ld, data: %ld, retransmissions: %ld, dropped: %ld, acks: %ld,"
+           " corrupt: %ld, duplicates: %ld, syscalls: %lu (%.3f per segment), cpu: %.3f s\n",
+           who, st->nsegs, st->ndata, st->nretransmit, st->ndropped, st->nack, st->ncorrupt,
+           st->nduplicate, st->nsyscalls, st->nsegs > 0 ? (double)st->nsyscalls / st->nsegs : 0.0,
+           st->cpu);
+}
+
+int main(int argc, char **argv) {
+    struct options opt = {0, 0, DEFAULT_MSS, DEFAULT_WINDOW, DEFAULT_RTO_MS};
+    const char *mode;
+    int c;
+
+    if (argc < 2) {
+        usage();
+    }
+    mode = argv[1];
+    optind = 2;
+    while ((c = getopt(argc, argv, "l:s:m:w:t:")) != -1) {
+        switch (c) {
+        case 'l':
+            opt.loss = atof(optarg);
+            break;
+        case 's':
+            opt.seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'm':
+            opt.mss = atoi(optarg);
+            break;
+        case 'w':
+            opt.window = atoi(optarg);
+            break;
+        case 't':
+            opt.rto = atof(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (opt.mss < 1 || opt.mss > MAX_MSS_BYTES || opt.window < 1 || opt.window > MAX_WINDOW ||
+        opt.rto <= 0 || opt.loss < 0 || opt.loss >= 1) {
+        usage();
+    }
+    rng_state ^= opt.seed * 0x9E3779B97F4A7C15ULL;
+
+    if (strcmp(mode, "recv") == 0 && argc - optind == 2) {
+        int fd = open_socket("0.0.0.0", atoi(argv[optind]));
+        double cpu0 = udpio_cpu();
+        struct stats st = run_receiver(fd, argv[optind + 1], &opt);
+        st.nsyscalls = udpio_nsyscalls;
+        st.cpu = udpio_cpu() - cpu0;
+        print_stats("receiver", &st);
+    } else if (strcmp(mode, "send") == 0 && argc - optind == 3) {
+        struct sockaddr_in peer;
+        int fd = open_socket("0.0.0.0", 0);
+        double start = udpio_clock(), cpu0 = udpio_cpu();
+
+        memset(&peer, 0, sizeof(peer));
+        peer.sin_family = AF_INET;
+        peer.sin_port = htons(atoi(argv[optind + 1]));
+        if (inet_pton(AF_INET, argv[optind], &peer.sin_addr) != 1) {
+            usage();
+        }
+        connect_to(fd, &peer);
+        struct stats st = run_sender(fd, argv[optind + 2], &opt);
+        double elapsed = udpio_clock() - start;
+        st.nsyscalls = udpio_nsyscalls;
+        st.cpu = udpio_cpu() - cpu0;
+        print_stats("sender", &st);
+        printf(" %.3f s\n", elapsed);
+    } else if (strcmp(mode, "bench") == 0 && argc - optind == 2) {
+        /* 接收方是子进程，统计从管道传回来 */
+        struct sockaddr_in addr;
+        socklen_t alen = sizeof(addr);
+        struct stat sb;
+        struct stats rs;
+        int pipefd[2];
+        int rfd = open_socket("127.0.0.1", 0);
+        int sfd = open_socket("127.0.0.1", 0);
+
+        if (stat(argv[optind], &sb) < 0) {
+            die(argv[optind]);
+        }
+        getsockname(rfd, (struct sockaddr *)&addr, &alen);
+        connect_to(sfd, &addr);
+        if (pipe(pipefd) < 0) {
+            die("pipe");
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(sfd);
+            rng_state ^= 0x5DEECE66DULL; /* 与发送方不同的丢失序列 */
+            double cpu0 = udpio_cpu();
+            struct stats st = run_receiver(rfd, argv[optind + 1], &opt);
+            st.nsyscalls = udpio_nsyscalls;
+            st.cpu = udpio_cpu() - cpu0;
+            if (write(pipefd[1], &st, sizeof(st)) != sizeof(st)) {
+                _exit(1);
+            }
+            _exit(0);
+        }
+        close(rfd);
+        double start = udpio_clock(), cpu0 = udpio_cpu();
+        struct stats ss = run_sender(sfd, argv[optind], &opt);
+        double elapsed = udpio_clock() - start; /* 接收方收齐之后还要停留 LINGER，不算在内 */
+        ss.nsyscalls = udpio_nsyscalls;
+        ss.cpu = udpio_cpu() - cpu0;
+        if (read(pipefd[0], &rs, sizeof(rs)) != sizeof(rs)) {
+            fprintf(stderr, "srcopy: receiver failed\n");
+            exit(1);
+        }
+        waitpid(pid, NULL, 0);
+        printf(" %lld bytes, mss: %d, window: %d, loss: %g: %.3f s, %.3f GB/s, %.3f syscalls per segment\n",
+               (long long)sb.st_size, opt.mss, opt.window, opt.loss, elapsed,
+               sb.st_size / elapsed / 1e9, (double)(ss.nsyscalls + rs.nsyscalls) / ss.nsegs);
+        print_stats("sender", &ss);
+        print_stats("receiver", &rs);
+    } else {
+        usage();
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "threads.h"
+
+static pthread_barrier_t barrier;
+
+void threads_run(int n, void *(*worker)(void *))
+{
+    pthread_t *threads = (pthread_t *)malloc(n * sizeof(pthread_t));
+    int i;
+
+    for (i = 1; i < n; i++)
+        pthread_create(&threads[i], NULL, worker, (void *)(long)i);
+    worker((void *)0);
+    for (i = 1; i < n; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+}
+
+void threads_barrier_init(int n)
+{
+    pthread_barrier_init(&barrier, NULL, n);
+}
+
+void threads_barrier_wait()
+{
+    pthread_barrier_wait(&barrier);
+}
+
+unsigned long long threads_clock_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -0,0 +1,21 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+/* the little of pthreads that the parallel mode of emulator.c needs.   */
+/* It lives in its own file because <pthread.h> brings in <time.h>,    */
+/* whose time() clashes with the simulated clock "time" of rdt.h.       */
+
+/* run worker(0) .. worker(n-1) on n threads, worker(0) on the calling */
+/* one, and return when they have all returned                         */
+void threads_run(int n, void *(*worker)(void *));
+
+/* a barrier for n threads */
+void threads_barrier_init(int n);
+void threads_barrier_wait();
+
+/* the monotonic clock in nanoseconds, for the profiler of emulator.c */
+/* (-DPROFILE=1) where there is no cycle counter to read; here for    */
+/* the same reason                                                    */
+unsigned long long threads_clock_ns();
+
+#endif
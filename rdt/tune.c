@@ -0,0 +1,381 @@
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * 窗口大小和重传超时的自动调优：
+ *   ./tune.out [-p 协议,...] [-L 时延上限] [-n 消息数] [-j 并行数] [-s 种子] 丢失率,损坏率,到达间隔 ...
+ *
+ * WINDOW_SIZE（sr.c 的 MAX_SEQ 随之取 2 倍）和 TIMEOUT_INTERVAL 是编译时常量，
+ * 所以每组候选参数先用 -D 编译出一个模拟器放在 tune.d/ 下，之后的模拟都 fork/exec 这些程序，
+ * 最多 -j 个同时运行。
+ *
+ * 每个协议、每个工作点各做一次逐次减半（successive halving）：第一轮所有候选各跑一次
+ * -n 条消息的短模拟，按得分保留前 1/3，下一轮消息数乘 3、种子数加倍（最多 8 个），
+ * 直到只剩一组参数。同一轮的各个候选用同样的种子和 -k（公共随机数），
+ * 候选之间的差别不会被信道的随机性淹没。
+ *
+ * 得分：A->B 平均时延不超过 -L 的候选排在前面，超过上限的排在后面；
+ * 两组内部都按吞吐量排，吞吐量相差 1% 以内再按时延排。
+ * 最后输出每个工作点推荐的参数表，没有候选满足上限的行标 *。
+ */
+
+#define TUNE_DIR "tune.d"
+#define MAX_POINTS 64
+#define MAX_CONFIGS 64
+#define MAX_SEEDS 8
+#define MAX_ARGS 16
+#define ETA 3 /* 每轮保留前 1/ETA */
+
+struct protocol {
+    const char *name;
+    const char *sources[8];
+    int nwindows;
+    int windows[8];
+    int ntimeouts;
+    double timeouts[8];
+};
+
+/* ABP 没有窗口，只搜索超时；默认值（20 和 600）都在网格里 */
+static const struct protocol protocols[] = {
+    {"abp", {"abp.c", "checksum.c", "emulator.c", "threads.c"}, 1, {1},
+     7, {10, 15, 20, 30, 50, 100, 200}},
+    {"gbn", {"gbn.c", "checksum.c", "fec.c", "emulator.c", "threads.c"}, 5, {2, 4, 8, 16, 32},
+     6, {50, 100, 200, 400, 600, 1000}},
+    {"sr", {"sr.c", "checksum.c", "fec.c", "emulator.c", "threads.c"}, 5, {2, 4, 8, 16, 32},
+     6, {50, 100, 200, 400, 600, 1000}},
+};
+#define NPROTOCOLS (int)(sizeof(protocols) / sizeof(protocols[0]))
+
+struct point {
+    double loss, corrupt, lambda;
+};
+
+struct config {
+    int window;
+    double timeout;
+    char binary[64];
+    double goodput, latency; /* 最近一轮的平均值 */
+};
+
+/* 一个子进程：argv 执行的程序，input 写到它的标准输入，标准输出写到 out */
+struct job {
+    char *argv[MAX_ARGS];
+    char args[MAX_ARGS][64];
+    char input[128];
+    char out[64];
+    pid_t pid;
+    int failed;
+};
+
+static int max_jobs = 1;
+static double latency_bound = 200.0;
+static int base_msgs = 300;
+static unsigned base_seed = 1;
+
+/* ========== 子进程 ========== */
+
+static void job_set(struct job *j, int argc, const char **argv) {
+    for (int i = 0; i < argc; i++) {
+        snprintf(j->args[i], sizeof(j->args[i]), "%s", argv[i]);
+        j->argv[i] = j->args[i];
+    }
+    j->argv[argc] = NULL;
+}
+
+static void job_start(struct job *j) {
+    int in[2];
+
+    if (pipe(in) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    j->pid = fork();
+    if (j->pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (j->pid == 0) {
+        int out = open(j->out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out < 0) {
+            _exit(127);
+        }
+        dup2(in[0], 0);
+        dup2(out, 1);
+        dup2(out, 2);
+        close(in[0]);
+        close(in[1]);
+        close(out);
+        execvp(j->argv[0], j->argv);
+        _exit(127);
+    }
+    /* 一行输入远小于管道缓冲，写入不会阻塞 */
+    close(in[0]);
+    if (j->input[0] && write(in[1], j->input, strlen(j->input)) < 0) {
+        perror("write");
+    }
+    close(in[1]);
+}
+
+/* 同时最多运行 max_jobs 个子进程，全部结束后返回 */
+static void run_jobs(struct job *jobs, int n) {
+    int next = 0, running = 0;
+
+    while (next < n || running > 0) {
+        while (next < n && running < max_jobs) {
+            job_start(&jobs[next++]);
+            running++;
+        }
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0) {
+            perror("wait");
+            exit(1);
+        }
+        for (int i = 0; i < next; i++) {
+            if (jobs[i].pid == pid) {
+                jobs[i].failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+                jobs[i].pid = 0;
+                running--;
+            }
+        }
+    }
+}
+
+/* ========== 编译候选参数 ========== */
+
+static void build_configs(const struct protocol *p, struct config *configs, int nconfigs) {
+    struct job *jobs = calloc(nconfigs, sizeof(struct job));
+    const char *cc = getenv("CC") ? getenv("CC") : "gcc";
+
+    for (int i = 0; i < nconfigs; i++) {
+        char window[32], timeout[48];
+        const char *argv[MAX_ARGS] = {cc, "-O2", window, timeout, "-o", configs[i].binary};
+        int argc = 6;
+
+        snprintf(configs[i].binary, sizeof(configs[i].binary), TUNE_DIR "/%s_w%d_t%g.out",
+                 p->name, configs[i].window, configs[i].timeout);
+        snprintf(window, sizeof(window), "-DWINDOW_SIZE=%d", configs[i].window);
+        snprintf(timeout, sizeof(timeout), "-DTIMEOUT_INTERVAL=%.1f", configs[i].timeout);
+        for (int k = 0; p->sources[k]; k++) {
+            argv[argc++] = p->sources[k];
+        }
+        argv[argc++] = "-lm";
+        argv[argc++] = "-pthread";
+        job_set(&jobs[i], argc, argv);
+        snprintf(jobs[i].out, sizeof(jobs[i].out), TUNE_DIR "/build%d.txt", i);
+    }
+    run_jobs(jobs, nconfigs);
+    for (int i = 0; i < nconfigs; i++) {
+        if (jobs[i].failed) {
+            fprintf(stderr, "tune: failed to build %s, see %s\n", configs[i].binary, jobs[i].out);
+            exit(1);
+        }
+        unlink(jobs[i].out);
+    }
+    free(jobs);
+}
+
+/* ========== 模拟与评分 ========== */
+
+/* 从模拟器输出里取 A->B 的吞吐量和平均时延，没有交付任何消息时时延记为无穷大 */
+static void parse_result(const char *file, double *goodput, double *latency) {
+    FILE *fp = fopen(file, "r");
+    char line[512];
+
+    *goodput = 0;
+    *latency = HUGE_VAL;
+    if (!fp) {
+        return;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        char *g, *l;
+        if (!strstr(line, "A->B") || !(g = strstr(line, "goodput: "))) {
+            continue;
+        }
+        *goodput = atof(g + strlen("goodput: "));
+        if ((l = strstr(line, "mean latency: "))) {
+            *latency = atof(l + strlen("mean latency: "));
+        }
+        break;
+    }
+    fclose(fp);
+}
+
+/* a 比 b 好时返回负数 */
+static int compare_configs(const struct config *a, const struct config *b) {
+    int fa = a->latency <= latency_bound, fb = b->latency <= latency_bound;
+
+    if (fa != fb) {
+        return fb - fa;
+    }
+    if (fabs(a->goodput - b->goodput) > 0.01 * fmax(a->goodput, b->goodput)) {
+        return a->goodput > b->goodput ? -1 : 1;
+    }
+    return (a->latency > b->latency) - (a->latency < b->latency);
+}
+
+static struct config *sort_base;
+
+static int compare_index(const void *a, const void *b) {
+    return compare_configs(&sort_base[*(const int *)a], &sort_base[*(const int *)b]);
+}
+
+/* 候选 cand[0..ncand) 在 nmsgs 条消息、nseeds 个种子下各跑一遍，结果取平均 */
+static void evaluate(struct config *configs, const int *cand, int ncand,
+                     const struct point *pt, int nmsgs, int nseeds) {
+    int n = ncand * nseeds;
+    struct job *jobs = calloc(n, sizeof(struct job));
+
+    for (int i = 0; i < n; i++) {
+        struct config *c = &configs[cand[i / nseeds]];
+        char seed[16];
+        const char *argv[] = {c->binary, "-k", "-s", seed};
+
+        snprintf(seed, sizeof(seed), "%u", base_seed + i % nseeds);
+        job_set(&jobs[i], 4, argv);
+        snprintf(jobs[i].input, sizeof(jobs[i].input), "%d %g %g %g 0\n",
+                 nmsgs, pt->loss, pt->corrupt, pt->lambda);
+        snprintf(jobs[i].out, sizeof(jobs[i].out), TUNE_DIR "/run%d.txt", i);
+    }
+    run_jobs(jobs, n);
+
+    for (int k = 0; k < ncand; k++) {
+        struct config *c = &configs[cand[k]];
+        c->goodput = c->latency = 0;
+        for (int s = 0; s < nseeds; s++) {
+            double goodput, latency;
+            parse_result(jobs[k * nseeds + s].out, &goodput, &latency);
+            unlink(jobs[k * nseeds + s].out);
+            c->goodput += goodput / nseeds;
+            c->latency += latency / nseeds;
+        }
+    }
+    free(jobs);
+}
+
+/* 逐次减半，返回最后剩下的候选 */
+static int successive_halving(struct config *configs, int nconfigs, const struct point *pt) {
+    int cand[MAX_CONFIGS];
+    int ncand = nconfigs, nmsgs = base_msgs, nseeds = 1;
+
+    for (int i = 0; i < nconfigs; i++) {
+        cand[i] = i;
+    }
+    for (;;) {
+        evaluate(configs, cand, ncand, pt, nmsgs, nseeds);
+        sort_base = configs;
+        qsort(cand, ncand, sizeof(int), compare_index);
+        if (ncand == 1) {
+            return cand[0];
+        }
+        ncand = (ncand + ETA - 1) / ETA;
+        nmsgs *= ETA;
+        if (nseeds < MAX_SEEDS) {
+            nseeds *= 2;
+        }
+    }
+}
+
+/* ========== 命令行 ========== */
+
+static int parse_point(const char *arg, struct point *pt) {
+    return sscanf(arg, "%lf,%lf,%lf", &pt->loss, &pt->corrupt, &pt->lambda) == 3;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: tune.out [-p abp,gbn,sr] [-L latency] [-n msgs] [-j jobs] [-s seed]"
+            " loss,corrupt,lambda ...\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    struct point points[MAX_POINTS];
+    int npoints = 0;
+    char which[64] = "abp,gbn,sr";
+    int opt;
+
+    max_jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "p:L:n:j:s:")) != -1) {
+        switch (opt) {
+        case 'p':
+            snprintf(which, sizeof(which), "%s", optarg);
+            break;
+        case 'L':
+            latency_bound = atof(optarg);
+            break;
+        case 'n':
+            base_msgs = atoi(optarg);
+            break;
+        case 'j':
+            max_jobs = atoi(optarg);
+            break;
+        case 's':
+            base_seed = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage();
+        }
+    }
+    for (; optind < argc && npoints < MAX_POINTS; optind++) {
+        if (!parse_point(argv[optind], &points[npoints++])) {
+            usage();
+        }
+    }
+    if (npoints == 0) {
+        /* 默认：无差错、中等差错、高差错，各配一个较轻和一个较重的负载 */
+        static const struct point defaults[] = {
+            {0, 0, 50}, {0, 0, 10}, {0.1, 0.1, 50}, {0.1, 0.1, 10}, {0.3, 0.1, 50}, {0.3, 0.1, 10},
+        };
+        npoints = sizeof(defaults) / sizeof(defaults[0]);
+        memcpy(points, defaults, sizeof(defaults));
+    }
+    if (max_jobs < 1 || base_msgs < 1) {
+        usage();
+    }
+    mkdir(TUNE_DIR, 0755);
+
+    printf("latency bound %g, %d msgs in the first round, %d jobs\n", latency_bound, base_msgs, max_jobs);
+    printf("protocol   loss corrupt  lambda  window  timeout    goodput    latency\n");
+    for (int p = 0; p < NPROTOCOLS; p++) {
+        const struct protocol *proto = &protocols[p];
+        struct config configs[MAX_CONFIGS];
+        int nconfigs = 0;
+        char list[66], name[16];
+
+        snprintf(list, sizeof(list), ",%s,", which);
+        snprintf(name, sizeof(name), ",%s,", proto->name);
+        if (!strstr(list, name)) {
+            continue;
+        }
+        for (int w = 0; w < proto->nwindows; w++) {
+            for (int t = 0; t < proto->ntimeouts; t++) {
+                configs[nconfigs].window = proto->windows[w];
+                configs[nconfigs].timeout = proto->timeouts[t];
+                nconfigs++;
+            }
+        }
+        build_configs(proto, configs, nconfigs);
+
+        for (int i = 0; i < npoints; i++) {
+            const struct point *pt = &points[i];
+            struct config *best = &configs[successive_halving(configs, nconfigs, pt)];
+            char window[16] = "-";
+
+            if (proto->nwindows > 1) {
+                snprintf(window, sizeof(window), "%d", best->window);
+            }
+            printf("%-8s %6g %7g %7g %7s %8g %10.5f %10.2f%s\n", proto->name,
+                   pt->loss, pt->corrupt, pt->lambda, window, best->timeout,
+                   best->goodput, best->latency, best->latency <= latency_bound ? "" : " *");
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,437 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> /* for getopt */
+
+#include "rdt.h"
+#include "udpio.h"
+
+/*****************************************************************
+******************* REAL NETWORK RUNTIME ************************
+The same protocol entities as with emulator.c (gbn.c, sr.c, abp.c),
+linked against this file instead, run over real UDP sockets:
+  - tolayer3() serializes the packet and sends it as one datagram over
+    a socket on 127.0.0.1 that is connected to the peer's socket
+  - starttimer()/stoptimer() arm and disarm a timerfd per entity, and
+    a single epoll loop waits for datagrams and timers of all entities
+  - tolayer5() writes the message to a sink (/dev/null unless -o)
+  - an injector in tolayer3() drops and corrupts datagrams with the
+    given probabilities, in place of the emulated channel; the kernel
+    may drop more when a socket buffer is full
+
+Layer 5 is a saturated source at every A, as with -S in the emulator:
+A gets a new message whenever entity_ready() says it can take one,
+until the flow has handed over its share.  The run ends when every B
+has delivered its share, and reports messages per second of wall
+time and the CPU time (user + system) and system calls per message.
+
+Protocol time is real time: "time" counts time units of -u
+microseconds (10 by default) since the start, so the timeouts of the
+protocols (e.g. 600 units in gbn.c and sr.c) become 6 ms.
+
+  ./gbn_udp.out [-m mss] [-n flows] [-s seed] [-u usec] [-o sink] msgs loss corrupt [trace]
+******************************************************************/
+
+#define WIRE_HEADER 16   /* seqnum, acknum, checksum, length in network order */
+#define STALL_SECONDS 5  /* give up when nothing is delivered for this long */
+
+struct endpoint
+{
+    int sock;          /* connected to the peer's socket */
+    int timer;         /* timerfd */
+    int timer_on;
+    long ngenerated;   /* messages layer 5 handed to this entity */
+    long ndelivered;   /* messages this entity passed up to layer 5 */
+    int refused;       /* dropped a message in this layer5_pull */
+    long nmisdelivered;
+    long nsent, nbytes, ndropped, ncorrupted; /* datagrams at tolayer3 */
+    long nreceived;
+};
+
+__thread float time;
+int TRACE;
+int mss = MSG_SIZE;
+int nflows = 1, nentities = 2;
+
+struct endpoint *endpoints;
+long nmsgs;             /* over all flows */
+float lossprob, corruptprob;
+double unit = 10e-6;    /* seconds per protocol time unit */
+double start;           /* udpio_clock() when the run began */
+unsigned long long rng = 88172645463325252ULL;
+FILE *sink;
+
+/* xorshift64*, for the injector */
+double injector_rand()
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return ((rng * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+void update_time()
+{
+    time = (float)((udpio_clock() - start) / unit);
+}
+
+/* messages flow f has to carry */
+long flow_quota(int f)
+{
+    return nmsgs / nflows + (f < nmsgs % nflows);
+}
+
+int layer5_done(int id)
+{
+    return endpoints[id & ~1].ngenerated == flow_quota(id / 2);
+}
+
+/* saturated source: hand A messages for as long as it takes them */
+void layer5_pull(int id)
+{
+    struct msg message;
+    struct endpoint *ep = &endpoints[id];
+
+    if (id & 1)
+        return;
+    ep->refused = 0;
+    while (!layer5_done(id) && entity_ready(id) && !ep->refused)
+    {
+        memset(message.data, 'a' + ep->ngenerated % 26, MSG_SIZE);
+        ep->ngenerated++;
+        entity_output(id, message);
+    }
+}
+
+/* the source only hands over what entity_ready() said the protocol   */
+/* would take; should it drop one all the same, take it back, so that */
+/* it is handed over again after the next event and the order check  */
+/* stays in step                                                      */
+void layer5_dropped(int id)
+{
+    endpoints[id].ngenerated--;
+    endpoints[id].refused = 1;
+}
+
+/* header fields in network byte order */
+void put32(unsigned char *p, int v)
+{
+    p[0] = (unsigned)v >> 24;
+    p[1] = (unsigned)v >> 16;
+    p[2] = (unsigned)v >> 8;
+    p[3] = (unsigned)v;
+}
+
+int get32(const unsigned char *p)
+{
+    return (int)((unsigned)p[0] << 24 | (unsigned)p[1] << 16 | (unsigned)p[2] << 8 | p[3]);
+}
+
+/************************** TOLAYER3 ***************/
+void tolayer3(int AorB, struct pkt packet)
+{
+    struct endpoint *ep = &endpoints[AorB];
+    unsigned char buf[WIRE_HEADER + MAX_PAYLOAD];
+    int len, bit;
+
+    ep->nsent++;
+    if (lossprob > 0 && injector_rand() < lossprob)
+    {
+        ep->ndropped++;
+        if (TRACE > 0)
+            printf("          TOLAYER3: packet being lost\n");
+        return;
+    }
+    len = packet.length;
+    if (len < 0 || len > MAX_PAYLOAD)
+        len = 0;
+    put32(buf, packet.seqnum);
+    put32(buf + 4, packet.acknum);
+    put32(buf + 8, packet.checksum);
+    put32(buf + 12, packet.length);
+    memcpy(buf + WIRE_HEADER, packet.payload, len);
+    len += WIRE_HEADER;
+    if (corruptprob > 0 && injector_rand() < corruptprob)
+    {
+        /* one bit anywhere in the datagram, header included */
+        bit = (int)(injector_rand() * len * 8);
+        buf[bit / 8] ^= 1 << (bit % 8);
+        ep->ncorrupted++;
+        if (TRACE > 0)
+            printf("          TOLAYER3: packet being corrupted\n");
+    }
+    ep->nbytes += len;
+    udpio_send(ep->sock, buf, len);
+}
+
+/* the datagram back into a packet; a length that does not match what */
+/* arrived is left for the checksum to catch                          */
+void from_wire(const unsigned char *buf, int len, struct pkt *packet)
+{
+    memset(packet, 0, sizeof(*packet));
+    packet->seqnum = get32(buf);
+    packet->acknum = get32(buf + 4);
+    packet->checksum = get32(buf + 8);
+    packet->length = get32(buf + 12);
+    len -= WIRE_HEADER;
+    if (len > MAX_PAYLOAD)
+        len = MAX_PAYLOAD;
+    memcpy(packet->payload, buf + WIRE_HEADER, len);
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+    struct endpoint *to = &endpoints[AorB], *from = &endpoints[AorB ^ 1];
+
+    if (to->ndelivered >= from->ngenerated || datasent[0] != 'a' + to->ndelivered % 26)
+        to->nmisdelivered++;
+    to->ndelivered++;
+    fwrite(datasent, 1, MSG_SIZE, sink);
+}
+
+/*********************** TIMERS ***********************/
+void stoptimer(int AorB)
+{
+    struct endpoint *ep = &endpoints[AorB];
+
+    if (!ep->timer_on)
+    {
+        printf("Warning: unable to cancel your timer. It wasn't running.\n");
+        return;
+    }
+    ep->timer_on = 0;
+    udpio_timer_set(ep->timer, 0);
+}
+
+void starttimer(int AorB, float increment)
+{
+    struct endpoint *ep = &endpoints[AorB];
+
+    if (ep->timer_on)
+    {
+        printf("Warning: attempt to start a timer that is already started\n");
+        return;
+    }
+    ep->timer_on = 1;
+    udpio_timer_set(ep->timer, increment * unit);
+}
+
+const char *entity_name(int id)
+{
+    static char names[4][16];
+    static int next;
+    char *name = names[next++ % 4];
+
+    if (nflows == 1)
+        sprintf(name, "%c", 'A' + (id & 1));
+    else
+        sprintf(name, "%c%d", 'A' + (id & 1), id / 2);
+    return name;
+}
+
+void trace_printf(const char *format, ...)
+{
+    va_list args;
+
+    if (TRACE <= 0)
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/* there are no checkpoints of a real network */
+void checkpoint_data(void *buf, int len)
+{
+    (void)buf;
+    (void)len;
+    fprintf(stderr, "checkpoints are not supported over UDP\n");
+    exit(1);
+}
+
+/********************* EVENT LOOP *******************/
+
+/* epoll tags: the socket of entity id is 2*id, its timer 2*id+1 */
+void handle(int tag)
+{
+    unsigned char buf[WIRE_HEADER + MAX_PAYLOAD];
+    struct pkt packet;
+    int id = tag / 2, i, len;
+    struct endpoint *ep = &endpoints[id];
+
+    update_time();
+    if (tag & 1)
+    {
+        /* a stop or restart since it went off clears the expiration */
+        if (udpio_timer_expired(ep->timer) && ep->timer_on)
+        {
+            ep->timer_on = 0;
+            entity_timerinterrupt(id);
+            layer5_pull(id);
+        }
+        return;
+    }
+    for (i = 0; i < 64; i++) /* then let the others have a turn */
+    {
+        len = udpio_recv(ep->sock, buf, sizeof(buf));
+        if (len < WIRE_HEADER)
+            break;
+        ep->nreceived++;
+        from_wire(buf, len, &packet);
+        entity_input(id, packet);
+        layer5_pull(id);
+        update_time();
+    }
+}
+
+int flows_done()
+{
+    int f;
+
+    for (f = 0; f < nflows; f++)
+        if (endpoints[2 * f + 1].ndelivered < flow_quota(f))
+            return 0;
+    return 1;
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: udp.out [-m mss] [-n flows] [-s seed] [-u usec] [-o sink]"
+                    " msgs loss corrupt [trace]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *sinkfile = "/dev/null";
+    long ndelivered = 0, last_delivered = -1, nmis = 0;
+    double cpu0, wall, cpu, last_progress;
+    int ep, id, i, n, opt, tags[64], fds[2];
+
+    while ((opt = getopt(argc, argv, "m:n:s:u:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            mss = atoi(optarg) / MSG_SIZE * MSG_SIZE;
+            if (mss < MSG_SIZE || mss > MAX_MSS)
+            {
+                fprintf(stderr, "mss must be between %d and %d bytes\n", MSG_SIZE, MAX_MSS);
+                exit(1);
+            }
+            break;
+        case 'n':
+            nflows = atoi(optarg);
+            if (nflows < 1)
+                usage();
+            break;
+        case 's':
+            rng ^= strtoull(optarg, NULL, 10) * 0x9E3779B97F4A7C15ULL;
+            if (rng == 0)
+                rng = 1;
+            break;
+        case 'u':
+            unit = atof(optarg) * 1e-6;
+            if (unit <= 0)
+                usage();
+            break;
+        case 'o':
+            sinkfile = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (argc - optind < 3 || argc - optind > 4)
+        usage();
+    nmsgs = atol(argv[optind]);
+    lossprob = (float)atof(argv[optind + 1]);
+    corruptprob = (float)atof(argv[optind + 2]);
+    if (argc - optind == 4)
+        TRACE = atoi(argv[optind + 3]);
+    if (nmsgs < 1)
+        usage();
+    if ((sink = fopen(sinkfile, "wb")) == NULL)
+    {
+        perror(sinkfile);
+        exit(1);
+    }
+
+    nentities = 2 * nflows;
+    endpoints = (struct endpoint *)calloc(nentities, sizeof(struct endpoint));
+    ep = udpio_poll();
+    for (id = 0; id < nentities; id += 2)
+    {
+        if (udpio_pair(fds) < 0)
+        {
+            perror("udp socket");
+            exit(1);
+        }
+        for (i = 0; i < 2; i++)
+        {
+            endpoints[id + i].sock = fds[i];
+            endpoints[id + i].timer = udpio_timer();
+            udpio_poll_add(ep, endpoints[id + i].sock, 2 * (id + i));
+            udpio_poll_add(ep, endpoints[id + i].timer, 2 * (id + i) + 1);
+        }
+    }
+
+    cpu0 = udpio_cpu();
+    start = last_progress = udpio_clock();
+    for (id = 0; id < nentities; id++)
+        entity_init(id);
+    for (id = 0; id < nentities; id++)
+        layer5_pull(id);
+    while (!flows_done())
+    {
+        n = udpio_poll_wait(ep, tags, 64, 1000);
+        for (i = 0; i < n; i++)
+            handle(tags[i]);
+        for (ndelivered = 0, id = 1; id < nentities; id += 2)
+            ndelivered += endpoints[id].ndelivered;
+        if (ndelivered != last_delivered)
+        {
+            last_delivered = ndelivered;
+            last_progress = udpio_clock();
+        }
+        else if (udpio_clock() - last_progress > STALL_SECONDS)
+        {
+            printf(" no progress for %d seconds, giving up\n", STALL_SECONDS);
+            break;
+        }
+    }
+    wall = udpio_clock() - start;
+    cpu = udpio_cpu() - cpu0;
+    update_time();
+    fclose(sink);
+
+    printf(" UDP loopback: %d flow(s), mss: %d, injected loss: %g, corruption: %g, time unit: %g us\n",
+           nflows, mss, lossprob, corruptprob, unit * 1e6);
+    for (id = 1; id < nentities; id += 2)
+        nmis += endpoints[id].nmisdelivered;
+    printf(" A->B: msgs: %ld, delivered to layer5: %ld in %f s, %.0f msgs/s", nmsgs, ndelivered, wall,
+           ndelivered / wall);
+    if (nmis > 0)
+        printf(", WRONG or out of order: %ld", nmis);
+    printf("\n");
+    printf(" cpu: %f s (user + system), %.3f us/msg, syscalls: %lu, %.2f per msg\n", cpu,
+           ndelivered > 0 ? cpu / ndelivered * 1e6 : 0.0, udpio_nsyscalls,
+           ndelivered > 0 ? (double)udpio_nsyscalls / ndelivered : 0.0);
+    for (i = 0; i < 2; i++)
+    {
+        long nsent = 0, nbytes = 0, ndropped = 0, ncorrupted = 0, nreceived = 0;
+        for (id = i; id < nentities; id += 2)
+        {
+            nsent += endpoints[id].nsent;
+            nbytes += endpoints[id].nbytes;
+            ndropped += endpoints[id].ndropped;
+            ncorrupted += endpoints[id].ncorrupted;
+            nreceived += endpoints[id ^ 1].nreceived;
+        }
+        printf(" %c->%c: packets to layer3: %ld, bytes: %ld, dropped: %ld, corrupted: %ld,"
+               " received: %ld\n", 'A' + i, 'B' - i, nsent, nbytes, ndropped, ncorrupted, nreceived);
+    }
+    protocol_stats();
+    return 0;
+}
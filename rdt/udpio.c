@@ -0,0 +1,154 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "udpio.h"
+
+#define SOCKET_BUFFER (4 * 1024 * 1024) /* room for a window's worth of datagrams */
+
+unsigned long udpio_nsyscalls;
+
+static int udpio_socket(struct sockaddr_in *addr)
+{
+    socklen_t len = sizeof(*addr);
+    int size = SOCKET_BUFFER;
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+
+    if (fd < 0)
+        return -1;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr->sin_port = 0; /* any free port */
+    if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) < 0 ||
+        getsockname(fd, (struct sockaddr *)addr, &len) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int udpio_pair(int fds[2])
+{
+    struct sockaddr_in addr[2];
+
+    if ((fds[0] = udpio_socket(&addr[0])) < 0)
+        return -1;
+    if ((fds[1] = udpio_socket(&addr[1])) < 0)
+    {
+        close(fds[0]);
+        return -1;
+    }
+    if (connect(fds[0], (struct sockaddr *)&addr[1], sizeof(addr[1])) < 0 ||
+        connect(fds[1], (struct sockaddr *)&addr[0], sizeof(addr[0])) < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    return 0;
+}
+
+int udpio_send(int fd, const void *buf, int len)
+{
+    udpio_nsyscalls++;
+    return (int)send(fd, buf, len, 0);
+}
+
+int udpio_recv(int fd, void *buf, int len)
+{
+    udpio_nsyscalls++;
+    return (int)recv(fd, buf, len, 0);
+}
+
+int udpio_timer()
+{
+    return timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+}
+
+/* setting the timer also clears the count of earlier expirations, so  */
+/* a stop or restart makes a pending one read as none                  */
+void udpio_timer_set(int fd, double seconds)
+{
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    if (seconds > 0)
+    {
+        its.it_value.tv_sec = (time_t)seconds;
+        its.it_value.tv_nsec = (long)((seconds - its.it_value.tv_sec) * 1e9);
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+            its.it_value.tv_nsec = 1; /* zero would disarm it */
+    }
+    udpio_nsyscalls++;
+    timerfd_settime(fd, 0, &its, NULL);
+}
+
+int udpio_timer_expired(int fd)
+{
+    unsigned long long n;
+
+    udpio_nsyscalls++;
+    if (read(fd, &n, sizeof(n)) != sizeof(n))
+        return 0;
+    return (int)n;
+}
+
+int udpio_poll()
+{
+    return epoll_create1(0);
+}
+
+void udpio_poll_add(int ep, int fd, int tag)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = (unsigned)tag;
+    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int udpio_poll_wait(int ep, int *tags, int max, int timeout_ms)
+{
+    struct epoll_event evs[64];
+    int i, n;
+
+    if (max > 64)
+        max = 64;
+    udpio_nsyscalls++;
+    do
+        n = epoll_wait(ep, evs, max, timeout_ms);
+    while (n < 0 && errno == EINTR);
+    for (i = 0; i < n; i++)
+        tags[i] = (int)evs[i].data.u32;
+    return n < 0 ? 0 : n;
+}
+
+double udpio_clock()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+double udpio_cpu()
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec +
+           ru.ru_stime.tv_usec * 1e-6;
+}
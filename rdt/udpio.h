@@ -0,0 +1,39 @@
+#ifndef UDPIO_H
+#define UDPIO_H
+
+/* the sockets, timers and clocks of the real-network runtime (udp.c),  */
+/* whose clocks and system call count srcopy.c also uses.               */
+/* Like threads.c, this lives in its own file because the system        */
+/* headers bring in <time.h>, whose time() clashes with the simulated   */
+/* clock "time" of rdt.h.  Every wrapper that enters the kernel adds    */
+/* one to udpio_nsyscalls.                                               */
+
+extern unsigned long udpio_nsyscalls;
+
+/* two non-blocking UDP sockets on 127.0.0.1, each connected to the   */
+/* other; returns 0, or -1 with errno set                              */
+int udpio_pair(int fds[2]);
+
+/* send one datagram on a connected socket; receive one, returning its */
+/* length, or -1 when there is none waiting                            */
+int udpio_send(int fd, const void *buf, int len);
+int udpio_recv(int fd, void *buf, int len);
+
+/* a non-blocking timerfd; arm it to go off once after the given time, */
+/* or disarm it with 0; read how often it went off since it was set   */
+int udpio_timer();
+void udpio_timer_set(int fd, double seconds);
+int udpio_timer_expired(int fd);
+
+/* an epoll set; fds are added for reading with a tag that wait hands  */
+/* back, up to max of them; wait returns how many, 0 after timeout_ms  */
+int udpio_poll();
+void udpio_poll_add(int ep, int fd, int tag);
+int udpio_poll_wait(int ep, int *tags, int max, int timeout_ms);
+
+/* the monotonic clock, and the CPU time (user + system) of the        */
+/* process so far, both in seconds                                     */
+double udpio_clock();
+double udpio_cpu();
+
+#endif